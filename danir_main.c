@@ -0,0 +1,3934 @@
+/**
+ * @file    danir_main.c
+ * @author  Dmytro Shytyi
+ * @date    14 Octobre 2018
+ * @date    23 September 2019
+ * @version 0.7
+ * @brief This is a Lite Linux Kernel Implementation of DHCPv6PD and NDP(DANIR).
+ * 	  Details in the IETF draft https://datatracker.ietf.org/doc/draft-shytyi-v6ops-danir
+ * @see https://dmytro.shytyi.net/ for a full description.
+ * @mail contact.dmytro@shytyi.net
+ * @credits Martin Mares, Gero Kuhlmann et al. Inspired by linux/net/ipv4/ipconfig.c
+ */
+
+
+
+
+#include <linux/init.h>             // Macros used to mark up functions e.g., __init __exit
+#include <linux/module.h>           // Core header for loading LKMs into the kernel
+#include <linux/kernel.h>           // Contains types, macros, functions for the kernel
+
+#include <linux/types.h>
+#include <linux/sched.h>
+#include <linux/mm.h>
+#include <linux/fcntl.h>
+#include <linux/socket.h>
+#include <linux/in.h>
+#include <linux/inet.h>
+#include <linux/skbuff.h>
+#include <linux/if_arp.h>
+#include <linux/netdevice.h> 
+#include <linux/etherdevice.h>
+#include <linux/netdevice.h> 
+#include <linux/etherdevice.h>
+#include <linux/string.h>
+#include <linux/ip.h> 
+#include <linux/udp.h>
+
+
+#include <linux/jiffies.h>
+#include <linux/random.h>
+#include <linux/utsname.h>
+#include <linux/if.h>
+#include <linux/inetdevice.h>
+#include <linux/route.h>
+
+#include <linux/root_dev.h>
+#include <linux/delay.h>
+#include <linux/slab.h>
+#include <linux/export.h>
+#include <linux/inetdevice.h>
+
+#include <net/net_namespace.h>
+#include <net/netns/generic.h>
+#include <linux/sysctl.h>
+#include <net/dsa.h>
+#include <net/ip.h>
+#include <net/ipconfig.h>
+#include <net/route.h>
+
+#include <linux/uaccess.h>
+#include <net/checksum.h>
+#include <asm/processor.h>
+
+#include <linux/ipv6.h>
+#include <linux/if_ether.h>
+#include <net/udp.h>
+#include <net/udp_tunnel.h>
+#include <net/ip6_checksum.h>
+
+#include <linux/utsname.h>
+#include <linux/time.h>
+
+
+#include <net/addrconf.h>
+#include <net/ip6_route.h>
+#include <net/ip6_fib.h>
+
+#include <linux/hrtimer.h>
+#include <linux/workqueue.h>
+#include <linux/hashtable.h>
+#include <linux/jhash.h>
+#include <linux/percpu.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/bitmap.h>
+#include <linux/icmpv6.h>
+#include <net/ndisc.h>
+
+#include "kd6_proto.h"
+
+#define CREATE_TRACE_POINTS
+#include "danir_trace.h"
+
+MODULE_LICENSE("GPL");              ///< The license type -- this affects runtime behavior
+MODULE_AUTHOR("Dmytro Shytyi");      ///< The author -- visible when you use modinfo
+MODULE_DESCRIPTION("[KD6] DANIR Kernel DHCPv6 Prefix Delegation"); 
+MODULE_VERSION("0.2");              ///< The version of the module
+
+
+
+
+
+
+/* Define the timeout for waiting for a DHCPv6PD reply */
+#define KD6_SEND_RETRIES  3 /* Transmissions of a bounded exchange */
+#define KD6_BASE_TIMEOUT (HZ*2) /* Initial timeout: 2 seconds */
+#define KD6_TIMEOUT_RANDOM (HZ) /* Maximum amount of randomization */
+#define KD6_TIMEOUT_MAX (HZ*30) /* Maximum allowed timeout */
+#define KD6_SOL_MAX_RT (HZ*3600) /* SOL_MAX_RT, section 7.6 of RFC 8415 */
+#define KD6_TIMEOUT_MULT *7/4 /* Rate of timeout growth */
+#define KD6_DAD_POLL (HZ/20) /* Wait for a link-local address past DAD */
+
+/* Renew/Rebind retransmission, section 5.5 of RFC 3315 */
+#define KD6_REN_TIMEOUT (HZ*10) /* Initial RENEW/REBIND timeout */
+#define KD6_REN_MAX_RT (HZ*600) /* Maximum RENEW/REBIND timeout */
+#define KD6_INFINITY 0xffffffff /* Infinite lifetime */
+
+/* Router Advertisements on the downstream ports, section 6.2 and 10 of RFC 4861 */
+#define KD6_RA_MAX_INTERVAL 30000 /* MaxRtrAdvInterval: 30 seconds */
+#define KD6_RA_MIN_INTERVAL (KD6_RA_MAX_INTERVAL/3) /* MinRtrAdvInterval */
+#define KD6_RA_BURST 3 /* MAX_INITIAL_RTR_ADVERTISEMENTS */
+#define KD6_RA_BURST_INTERVAL 1000 /* Initial RAs: 1 second apart at most */
+#define KD6_MIN_DELAY_BETWEEN_RAS 3000 /* MIN_DELAY_BETWEEN_RAS */
+#define KD6_MAX_RA_DELAY_TIME 500 /* MAX_RA_DELAY_TIME */
+#define KD6_RS_BURST 10 /* Router Solicitations handled back to back */
+#define KD6_RS_RATE 2 /* and per second, per port */
+#define KD6_RA_LIFETIME (3*KD6_RA_MAX_INTERVAL/1000) /* AdvDefaultLifetime, seconds */
+#define KD6_MIN_MTU 364 /* Smaller links can't carry our messages */
+
+/* Emulation of many requesting routers, see kd6_emu_start() */
+#define KD6_EMU_MAX (1 << 24) /* Routers at most: their IAIDs must differ */
+#define KD6_EMU_MAX_DEVS 16 /* Interfaces at most */
+#define KD6_EMU_TICK max(HZ/100, 1) /* Timer wheel granularity: 10 ms */
+#define KD6_EMU_WHEEL_BITS 8 /* Wheel slots: a round is 2.56 seconds */
+#define KD6_EMU_XID_BITS 16 /* Buckets of the xid hash */
+#define KD6_EMU_LAT_MAX 4095 /* Latency histogram, 1 ms buckets */
+#define KD6_EMU_BACKOFF (HZ*10) /* A router that gave up starts over */
+
+/* Delegating server, see kd6_pds_rcv() */
+#define KD6_PDS_HASH_BITS 8 /* Buckets of the binding table */
+#define KD6_PDS_WHEEL_BITS 8 /* Expiry wheel, one slot per second */
+#define KD6_PDS_OFFER_TIME 60 /* Seconds an ADVERTISEd prefix is held */
+
+/* UDP ports, defined in section 5.2 of RFC 3315 */
+#define KD6_CLIENT_PORT 546
+#define KD6_SERVER_PORT 547
+#define KD6_UDP_ENCAP     1 /* Any non-zero type enables encap_rcv */
+
+/*
+ * DHCPv6PD client states, one per candidate uplink. The client transmits
+ * and accepts replies in SOLICIT, REQUEST, RENEW and REBIND; every
+ * transition is made under kn->lock.
+ */
+enum kd6_state {
+	KD6_STATE_IDLE,		/* Not started, or module going away */
+	KD6_STATE_SOLICIT,	/* SOLICIT sent, waiting for ADVERTISE */
+	KD6_STATE_REQUEST,	/* REQUEST sent, waiting for REPLY */
+	KD6_STATE_BOUND,	/* REPLY received, prefix delegated */
+	KD6_STATE_RENEW,	/* T1 passed, RENEW sent to our server */
+	KD6_STATE_REBIND,	/* T2 passed, REBIND sent to any server */
+};
+
+#define KD6_DEV_HASH_BITS 10
+
+struct kd6_device;
+struct kd6_lease_blob;
+struct kd6_emu;
+struct kd6_reply;
+
+/*
+ * One instance per network namespace, started once its net.danir.enable
+ * sysctl is set; the initial namespace has it set by default. Each has
+ * its own devices, uplink, lease and sockets.
+ *
+ * Every device it manages is in dev_table, by ifindex. Until the first
+ * lease is configured they are all candidate uplinks, each running its
+ * own DHCPv6 transaction; after that only the uplink does and the others
+ * are downstream ports. The table is only used from kd6_wq; the receive
+ * path finds its devices through xid_table, under the lock.
+ */
+struct kd6_net {
+	struct net *net;
+	int enable;			/* net.danir.enable */
+	struct ctl_table_header *sysctl;
+	bool running;			/* Sockets open, devices managed */
+	bool dying;			/* Namespace going away */
+	spinlock_t lock;		/* Receive path vs. process context */
+	DECLARE_HASHTABLE(dev_table, KD6_DEV_HASH_BITS);
+	DECLARE_HASHTABLE(xid_table, 6); /* Transactions by xid */
+	struct kd6_device *uplink;	/* Holds the lease */
+	bool configured;		/* Interfaces set up from a lease */
+	bool withdrawn;			/* and taken back when it ran out */
+	struct socket *sock;		/* DHCPv6 client socket bound to port 546 */
+	struct socket *rs_sock;		/* Raw ICMPv6 socket for Router Solicitations */
+	void (*rs_data_ready_orig)(struct sock *sk);
+	struct socket *srv_sock;	/* Relay agent or delegating server socket, port 547 */
+	void (*srv_data_ready_orig)(struct sock *sk);
+
+	/* Subprefix allocator, see kd6_slot_alloc() */
+	unsigned long *slots;
+	unsigned int nslots;
+	u64 slots_base;			/* Delegated prefix, host order */
+	u8 slots_plen;			/* and its length */
+	struct in6_addr aggr;		/* Delegated prefix routed unreachable */
+	u8 aggr_plen;
+	bool aggr_routed;
+
+	struct kd6_lease_blob *lease_cache; /* Written, not applied yet */
+	struct kd6_emu *emu;		/* Emulated routers, if any */
+	u16 dns_len;			/* DNS options of the lease, from kd6_wq */
+	u8 dns[KD6_DNS_MAX];
+
+	/* Delegating server, see kd6_pds_rcv() */
+	DECLARE_HASHTABLE(pds_bindings, KD6_PDS_HASH_BITS); /* By DUID and IAID */
+	struct hlist_head pds_wheel[1 << KD6_PDS_WHEEL_BITS]; /* By expiry */
+	time64_t pds_clock;		/* Last second the wheel turned to */
+	unsigned int pds_count;		/* Bindings and offers */
+	struct delayed_work pds_work;	/* Turns the wheel */
+
+	struct work_struct config_work;	/* Registry sync, start and stop */
+	struct work_struct xmit_work;
+	struct work_struct bound_work;
+	struct work_struct lease_work;
+	struct work_struct rs_work;
+	struct work_struct srv_work;
+};
+
+static unsigned int kd6_net_id;
+static atomic_t kd6_ra_gen; /* Bumped when link addresses or MTUs change */
+static atomic_t kd6_tmpl_gen; /* Bumped when link addresses change */
+static struct workqueue_struct *kd6_wq; /* Ordered, runs all client work */
+static struct in6_addr kd6_gateway; /* Gateway IP address */
+static char kd6_user_dev_name[IFNAMSIZ] ;
+struct in6_addr KD6_LINK_LOCAL_MULTICAST = {{{ 0xff,02,0,0,0,0,0,0,0,0,0,0,0,1,0,2 }}};
+struct in6_addr KD6_LINK_NULL = {{{ 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0 }}};
+static const u8 kd6_all_servers_hw[ETH_ALEN] = { 0x33,0x33,0x00,0x01,0x00,0x02 };
+
+static char *port_size;
+module_param(port_size, charp, 0444);
+MODULE_PARM_DESC(port_size, "Prefix length per downstream port, e.g. eth2=60,eth3=60 (default 64)");
+
+static bool rapid_commit;
+module_param(rapid_commit, bool, 0444);
+MODULE_PARM_DESC(rapid_commit, "Ask for a two-message SOLICIT/REPLY exchange (Rapid Commit)");
+
+static char *relay;
+module_param(relay, charp, 0444);
+MODULE_PARM_DESC(relay, "Relay the DHCPv6 messages of the downstream ports to this server, e.g. ff05::1:3");
+static struct in6_addr kd6_relay_server;
+
+static unsigned int delegate;
+module_param(delegate, uint, 0444);
+MODULE_PARM_DESC(delegate, "Delegate prefixes of this length to downstream requesting routers, e.g. 60 (0: off)");
+
+static bool init_enable = true;
+module_param(init_enable, bool, 0444);
+MODULE_PARM_DESC(init_enable, "net.danir.enable of the initial namespace at load (default 1)");
+
+static unsigned int emulate;
+module_param(emulate, uint, 0444);
+MODULE_PARM_DESC(emulate, "Emulate this many requesting routers instead of running the client (load testing)");
+
+static char *emulate_dev;
+module_param(emulate_dev, charp, 0444);
+MODULE_PARM_DESC(emulate_dev, "Interfaces of the emulated routers, e.g. eth1,eth2");
+
+static unsigned int emulate_rate = 1000;
+module_param(emulate_rate, uint, 0444);
+MODULE_PARM_DESC(emulate_rate, "SOLICITs per second of the emulated routers (default 1000)");
+
+static unsigned int emulate_period;
+module_param(emulate_period, uint, 0444);
+MODULE_PARM_DESC(emulate_period, "Seconds an emulated router stays bound before it reboots, 0 for never");
+
+
+
+
+
+/*
+ * Network devices
+ *
+ * Every candidate uplink runs its own DHCPv6 transaction: xid, state,
+ * retransmission and lease timers, and the lease it was offered. The
+ * first device to get a REPLY becomes the uplink of its namespace and
+ * drives the configuration of the others.
+ */
+struct kd6_device{
+	struct kd6_net *kn;		/* Its namespace */
+	struct hlist_node node;		/* In kn->dev_table */
+	int ifindex;			/* Its key */
+	struct net_device *dev;		/* Held while registered here */
+	bool up;			/* Running with a carrier */
+	u8 xid[3];
+	struct hlist_node xid_node;	/* In kn->xid_table while in a transaction */
+	enum kd6_state state;
+	unsigned long flags;		/* KD6_DEV_* work requests */
+	unsigned long start_jiffies;	/* Start of the exchange */
+	unsigned long msg_jiffies;	/* First transmission of the message */
+	unsigned long timeout;		/* Current retransmission timeout */
+	int retries;			/* Transmissions left, <0 unlimited */
+	struct hrtimer rtx_timer;	/* Retransmission timer */
+	struct hrtimer lease_timer;	/* Fires at T1, T2 and expiry */
+	ktime_t lease_due;		/* When it was last armed for */
+	struct sk_buff *tmpl;		/* Prebuilt frame of the current message */
+	u8 tmpl_type;			/* Its message type */
+	u8 tmpl_xid[3];			/* and transaction */
+	u16 tmpl_time_off;		/* Offset of its Elapsed Time value */
+	int tmpl_gen;			/* kd6_tmpl_gen it was built for */
+
+	/* Lease */
+	struct dhcpv6_server_id server_id;
+	struct dhcpv6_ia_pd ia_pd;
+	struct dhcpv6_ia_prefix ia_prefix;
+	struct in6_addr servaddr;	/* Server that granted the lease */
+	u8 servaddr_hw[6];
+	ktime_t lease_start;		/* When the lease was granted */
+	time64_t lease_real;		/* Same, wall clock seconds */
+	u32 t1, t2, valid;		/* Seconds */
+	u16 dns_len;			/* DNS options of the last REPLY */
+	u8 dns[KD6_DNS_MAX];
+
+	/* Downstream port */
+	unsigned int slot;		/* First /64 of its subprefix */
+	u8 slot_len;			/* Subprefix length, 0 when none */
+	struct in6_addr prefix;		/* Its /64, the first of the subprefix */
+	struct in6_addr route;		/* Subprefix routed to the port */
+	u8 route_plen;			/* Its length, 0 when not routed */
+	struct hrtimer ra_timer;	/* Next RA */
+	struct work_struct ra_work;	/* Sends it, one per port */
+	int ra_burst;			/* Initial RAs left */
+	struct sk_buff *ra_tmpl;	/* Prebuilt RA, sent as clones */
+	int ra_gen;			/* kd6_ra_gen it was built for */
+	ktime_t ra_last;		/* Last RA sent */
+	bool ra_mc;			/* Joined all-routers */
+	bool relay_mc;			/* Joined All_DHCP_Relay_Agents_and_Servers */
+	unsigned int rs_tokens;		/* RS token bucket */
+	unsigned long rs_stamp;		/* Last refill */
+};
+
+/* kd6_device flags, set by the timers and consumed by kd6_wq */
+#define KD6_DEV_XMIT	0	/* (Re)transmit the current message */
+#define KD6_DEV_LEASE	1	/* T1, T2 or expiry reached */
+
+
+/*
+ * Statistics, per CPU so that the fast paths never share a cache line.
+ * Read without locking through debugfs (kd6/stats).
+ */
+enum kd6_stat {
+	KD6_STAT_RX,			/* Inspected by kd6_rcv_pkt() */
+	KD6_STAT_DROP_PORT,		/* Not from the server port */
+	KD6_STAT_DROP_TYPE,		/* Neither ADVERTISE nor REPLY */
+	KD6_STAT_DROP_MALFORMED,	/* Options did not parse */
+	KD6_STAT_DROP_STATUS,		/* Error status or no server id */
+	KD6_STAT_DROP_XID,		/* No transaction with that xid */
+	KD6_STAT_DROP_STATE,		/* Already got a reply */
+	KD6_STAT_DROP_NOPREFIX,		/* Nothing usable offered */
+	KD6_STAT_TX_SOLICIT,
+	KD6_STAT_TX_REQUEST,
+	KD6_STAT_TX_RENEW,
+	KD6_STAT_TX_REBIND,
+	KD6_STAT_TX_RETRANS,		/* Of which retransmissions */
+	KD6_STAT_TX_ERR,
+	KD6_STAT_TX_RA,
+	KD6_STAT_RX_RS,			/* Router Solicitations */
+	KD6_STAT_DROP_RS,		/* Invalid or over the rate */
+	KD6_STAT_RELAY_FORW,		/* Relayed to the server */
+	KD6_STAT_RELAY_REPL,		/* Relayed back to a port */
+	KD6_STAT_DROP_RELAY,		/* Not relayed */
+	KD6_STAT_PDS_RX,		/* From downstream requesting routers */
+	KD6_STAT_PDS_BIND,		/* Bindings made or extended */
+	KD6_STAT_PDS_NOPREFIX,		/* No room for one more */
+	KD6_STAT_PDS_EXPIRE,		/* Bindings timed out */
+	KD6_STAT_DROP_PDS,		/* Not answered */
+	KD6_STAT_INFO_REPLY,		/* INFORMATION-REQUESTs answered */
+	KD6_STAT_DROP_INFO,		/* Not answered */
+	KD6_STAT_MAX
+};
+
+static const char *const kd6_stat_names[KD6_STAT_MAX] = {
+	[KD6_STAT_RX]			= "rx",
+	[KD6_STAT_DROP_PORT]		= "drop_port",
+	[KD6_STAT_DROP_TYPE]		= "drop_type",
+	[KD6_STAT_DROP_MALFORMED]	= "drop_malformed",
+	[KD6_STAT_DROP_STATUS]		= "drop_status",
+	[KD6_STAT_DROP_XID]		= "drop_xid",
+	[KD6_STAT_DROP_STATE]		= "drop_state",
+	[KD6_STAT_DROP_NOPREFIX]	= "drop_noprefix",
+	[KD6_STAT_TX_SOLICIT]		= "tx_solicit",
+	[KD6_STAT_TX_REQUEST]		= "tx_request",
+	[KD6_STAT_TX_RENEW]		= "tx_renew",
+	[KD6_STAT_TX_REBIND]		= "tx_rebind",
+	[KD6_STAT_TX_RETRANS]		= "tx_retrans",
+	[KD6_STAT_TX_ERR]		= "tx_err",
+	[KD6_STAT_TX_RA]		= "tx_ra",
+	[KD6_STAT_RX_RS]		= "rx_rs",
+	[KD6_STAT_DROP_RS]		= "drop_rs",
+	[KD6_STAT_RELAY_FORW]		= "relay_forw",
+	[KD6_STAT_RELAY_REPL]		= "relay_repl",
+	[KD6_STAT_DROP_RELAY]		= "drop_relay",
+	[KD6_STAT_PDS_RX]		= "pds_rx",
+	[KD6_STAT_PDS_BIND]		= "pds_bind",
+	[KD6_STAT_PDS_NOPREFIX]		= "pds_noprefix",
+	[KD6_STAT_PDS_EXPIRE]		= "pds_expire",
+	[KD6_STAT_DROP_PDS]		= "drop_pds",
+	[KD6_STAT_INFO_REPLY]		= "info_reply",
+	[KD6_STAT_DROP_INFO]		= "drop_info",
+};
+
+/* Latency histograms, bucket n counts [2^(n-1), 2^n) milliseconds */
+enum kd6_hist {
+	KD6_HIST_ADVERTISE,		/* SOLICIT to ADVERTISE */
+	KD6_HIST_REPLY,			/* REQUEST/RENEW/REBIND to REPLY */
+	KD6_HIST_PREFIX,		/* SOLICIT to bound */
+	KD6_HIST_MAX
+};
+#define KD6_HIST_BUCKETS 24
+
+static const char *const kd6_hist_names[KD6_HIST_MAX] = {
+	[KD6_HIST_ADVERTISE]	= "solicit_advertise_ms",
+	[KD6_HIST_REPLY]	= "request_reply_ms",
+	[KD6_HIST_PREFIX]	= "time_to_prefix_ms",
+};
+
+struct kd6_stats {
+	unsigned long cnt[KD6_STAT_MAX];
+	unsigned long hist[KD6_HIST_MAX][KD6_HIST_BUCKETS];
+};
+
+static struct kd6_stats __percpu *kd6_stats;
+static struct dentry *kd6_debugfs;
+
+#define KD6_INC_STATS(field)	this_cpu_inc(kd6_stats->cnt[field])
+
+static void kd6_hist_add(enum kd6_hist h, unsigned long jiffies_diff)
+{
+	int b = fls(jiffies_to_msecs(jiffies_diff));
+
+	this_cpu_inc(kd6_stats->hist[h][min(b, KD6_HIST_BUCKETS - 1)]);
+}
+
+
+
+static void kd6_enter_state(struct kd6_device *d, enum kd6_state state);
+static void kd6_stop_xact(struct kd6_device *d);
+static bool kd6_emu_rcv(struct kd6_emu *e, u8 msg_type, const u8 *xid,
+		const struct kd6_reply *r);
+static enum hrtimer_restart kd6_rtx_timer_fn(struct hrtimer *timer);
+static enum hrtimer_restart kd6_lease_timer_fn(struct hrtimer *timer);
+static void kd6_ra_start(struct kd6_device *d);
+static void kd6_nd_network_prefix_send(struct kd6_device *d);
+static void kd6_ra_tmpl_free(struct kd6_device *d);
+static struct kd6_device *kd6_find_ifindex(struct kd6_net *kn, int ifindex);
+static void kd6_pds_flush(struct kd6_net *kn, int ifindex);
+
+
+
+static bool  kd6_is_init_dev(struct net_device *dev)
+{
+	if (dev->flags & IFF_LOOPBACK)
+		return false;
+	return kd6_user_dev_name[0] ? !strcmp(dev->name, kd6_user_dev_name) :
+		(!(dev->flags & IFF_LOOPBACK) &&
+		 (dev->flags & (IFF_POINTOPOINT|IFF_BROADCAST)) &&
+		 strncmp(dev->name, "dummy", 5));
+}
+
+
+
+/*
+ *  Transaction lookup by xid, called with kn->lock held.
+ */
+static inline u32 kd6_xid_key(const u8 *xid)
+{
+	return xid[0] << 16 | xid[1] << 8 | xid[2];
+}
+
+static struct kd6_device *kd6_xid_lookup(struct kd6_net *kn, const u8 *xid)
+{
+	struct kd6_device *d;
+
+	hash_for_each_possible(kn->xid_table, d, xid_node, kd6_xid_key(xid))
+		if (!memcmp(d->xid, xid, sizeof(d->xid)))
+			return d;
+	return NULL;
+}
+
+/*
+ *  Start a new transaction on the device: pick a fresh xid and rehash.
+ *  Called with kn->lock held.
+ */
+static void kd6_new_xid(struct kd6_device *d)
+{
+	struct kd6_net *kn = d->kn;
+
+	hash_del(&d->xid_node);
+	do {
+		get_random_bytes(d->xid, sizeof(d->xid));
+	} while (kd6_xid_lookup(kn, d->xid));
+	hash_add(kn->xid_table, &d->xid_node, kd6_xid_key(d->xid));
+}
+
+/*
+ *  Room for a reply whose message is not all in the skb's head, one per
+ *  CPU as the receive path runs in softirq context. Longer ones are
+ *  dropped, no server fills a link's MTU with its answer to a client.
+ */
+#define KD6_RX_MAX 1500
+static DEFINE_PER_CPU(u8 [KD6_RX_MAX], kd6_rx_buf);
+
+/*
+ *  Receive DHCPv6 reply.
+ *
+ *  Called as the encap_rcv handler of the client socket, so only datagrams
+ *  addressed to UDP port 546 ever get here, with the checksum already
+ *  verified and skb->data pointing at the UDP header. The skb is always
+ *  consumed.
+ */
+
+static int kd6_rcv_pkt(struct sock *sk, struct sk_buff *skb)
+{
+	struct kd6_net *kn = net_generic(sock_net(sk), kd6_net_id);
+	struct kd6_device *d;
+	struct kd6_reply reply;
+	struct ipv6hdr *ipv6h;
+	const u8 *dhp;
+	u8 rx_xid[3];
+	u8 msg_type;
+	int len;
+
+	pr_debug("KD6: Received DHCP packet");
+	KD6_INC_STATS(KD6_STAT_RX);
+
+	/* Message type and transaction id, then the options */
+	len = skb->len - (int)sizeof(struct udphdr);
+	if (len < 4)
+		goto drop;
+	if (len > KD6_RX_MAX) {
+		KD6_INC_STATS(KD6_STAT_DROP_MALFORMED);
+		goto drop;
+	}
+	/* In place when in the head, as it nearly always is; no linearizing */
+	dhp = skb_header_pointer(skb, sizeof(struct udphdr), len,
+			this_cpu_ptr(kd6_rx_buf));
+
+	if (udp_hdr(skb)->source != htons(KD6_SERVER_PORT)) {
+		KD6_INC_STATS(KD6_STAT_DROP_PORT);
+		goto drop;
+	}
+	ipv6h = ipv6_hdr(skb);
+
+	msg_type = dhp[0];
+	memcpy(rx_xid, dhp + 1, sizeof(rx_xid)); //Transaction ID
+	if (msg_type != KD6_ADVERTISE && msg_type != KD6_REPLY) {
+		KD6_INC_STATS(KD6_STAT_DROP_TYPE);
+		goto drop;
+	}
+
+	if (kd6_parse_received(dhp + 4, len - 4, &reply)) {
+		net_warn_ratelimited("KD6: Malformed message %d from %pI6c\n",
+				msg_type, &ipv6h->saddr);
+		KD6_INC_STATS(KD6_STAT_DROP_MALFORMED);
+		goto drop;
+	}
+	if (!reply.server_id_len || reply.status != KD6_STATUS_SUCCESS) {
+		net_dbg_ratelimited("KD6: Message %d from %pI6c refused, status %d\n",
+				msg_type, &ipv6h->saddr, reply.status);
+		KD6_INC_STATS(KD6_STAT_DROP_STATUS);
+		goto drop;
+	}
+
+	// One reply at a time, please.
+	spin_lock(&kn->lock);
+	// Find the transaction the reply belongs to
+	d = kd6_xid_lookup(kn, rx_xid);
+	if (!d){
+		/* Or one of an emulated router */
+		if (kn->emu && kd6_emu_rcv(kn->emu, msg_type, rx_xid, &reply))
+			goto drop_unlock;
+		net_dbg_ratelimited("KD6: Reply not for us on %s, rx_xid[%x%x%x]\n",
+				skb->dev ? skb->dev->name : "?",
+				rx_xid[0],rx_xid[1],rx_xid[2]);
+		KD6_INC_STATS(KD6_STAT_DROP_XID);
+		goto drop_unlock;
+	}
+	trace_kd6_rx(d->dev, msg_type, kd6_xid_key(rx_xid),
+			jiffies_to_msecs(jiffies - d->msg_jiffies));
+
+	switch (msg_type) {
+		case KD6_ADVERTISE:
+			if (d->state != KD6_STATE_SOLICIT)
+				goto drop_state;
+			/* No prefix offered (e.g. NoPrefixAvail), keep looking */
+			if (!reply.have_prefix)
+				goto drop_noprefix;
+			if (kd6_take_server(&d->server_id, &reply))
+				goto bad_duid;
+			kd6_hist_add(KD6_HIST_ADVERTISE, jiffies - d->msg_jiffies);
+			d->ia_pd = reply.ia_pd;
+			d->ia_prefix = reply.ia_prefix;
+			kd6_enter_state(d, KD6_STATE_REQUEST);
+			break;
+
+		case KD6_REPLY:
+			if (d->state == KD6_STATE_SOLICIT) {
+				/* Rapid Commit: the REPLY answers the SOLICIT */
+				if (!rapid_commit || !reply.rapid_commit)
+					goto drop_state;
+			} else if (d->state != KD6_STATE_REQUEST &&
+					d->state != KD6_STATE_RENEW &&
+					d->state != KD6_STATE_REBIND)
+				goto drop_state;
+			/* The server lost our binding: ask it again */
+			if (reply.ia_status == KD6_STATUS_NOBINDING &&
+					(d->state == KD6_STATE_RENEW ||
+					 d->state == KD6_STATE_REBIND)) {
+				if (kd6_take_server(&d->server_id, &reply))
+					goto bad_duid;
+				kd6_enter_state(d, KD6_STATE_REQUEST);
+				break;
+			}
+			if (!reply.have_prefix)
+				goto drop_noprefix;
+			if (kd6_take_server(&d->server_id, &reply))
+				goto bad_duid;
+			kd6_hist_add(KD6_HIST_REPLY, jiffies - d->msg_jiffies);
+			if (d->state == KD6_STATE_SOLICIT ||
+					d->state == KD6_STATE_REQUEST)
+				kd6_hist_add(KD6_HIST_PREFIX, jiffies - d->start_jiffies);
+			d->ia_pd = reply.ia_pd;
+			d->ia_prefix = reply.ia_prefix;
+			d->dns_len = reply.dns_len;
+			memcpy(d->dns, reply.dns, reply.dns_len);
+
+			pr_info("KD6: IPv6 GUNPs offered  %pI64 on %s, by server %pI64\n",
+					&(d->ia_prefix.prefix_addr), d->dev->name,
+					ipv6h->saddr.in6_u.u6_addr16);
+
+			/* Remember where to unicast RENEW to */
+			memcpy (&d->servaddr,&ipv6h->saddr,sizeof(d->servaddr));
+			if (skb_mac_header_was_set(skb))
+				memcpy(d->servaddr_hw, eth_hdr(skb)->h_source,
+						sizeof(d->servaddr_hw));
+			/* The fastest uplink wins */
+			if (!kn->uplink)
+				kn->uplink = d;
+			kd6_enter_state(d, KD6_STATE_BOUND);
+			break;
+
+		default:
+			//  Forget it/
+			goto drop_unlock;
+	}
+	goto drop_unlock;
+
+drop_state:
+	KD6_INC_STATS(KD6_STAT_DROP_STATE);
+	goto drop_unlock;
+
+drop_noprefix:
+	KD6_INC_STATS(KD6_STAT_DROP_NOPREFIX);
+	goto drop_unlock;
+
+bad_duid:
+	KD6_INC_STATS(KD6_STAT_DROP_STATUS);
+	net_warn_ratelimited("KD6: Server %pI6c DUID length %d invalid\n",
+			&ipv6h->saddr, reply.server_id_len);
+
+drop_unlock:
+	/* Show's over.  Nothing to see here.  */
+	spin_unlock(&kn->lock);
+
+drop:
+	/* Throw the packet out. */
+	kfree_skb(skb);
+	return 0;
+}
+
+/*
+ *  Allocate a frame for a 'len' bytes message, with room for the headers
+ *  in front of it. The message is zeroed and is all the skb holds.
+ */
+static struct sk_buff *kd6_msg_alloc(struct net_device *dev, int len, gfp_t gfp)
+{
+	struct sk_buff *skb;
+
+	skb = alloc_skb(sizeof(struct ethhdr) + 
+			sizeof(struct udphdr) + 
+			sizeof(struct ipv6hdr) + 
+			len, gfp);
+	if (!skb)
+		return NULL;
+
+	skb->dev = dev;
+	skb->pkt_type = PACKET_OUTGOING;
+	skb->protocol = htons(ETH_P_IPV6);
+	skb->no_fcs = 1;  
+
+	skb_reserve(skb, sizeof (struct ethhdr) + sizeof(struct udphdr)+ sizeof(struct ipv6hdr));
+	skb_put_zero(skb, len);
+	return skb;
+}
+
+/*
+ *  Put the UDP, IPv6 and Ethernet headers in front of the message.
+ */
+static void kd6_msg_push_headers(struct sk_buff *skb, const struct in6_addr *saddr,
+		const struct in6_addr *daddr, const u8 *dest_hw)
+{
+	struct ipv6hdr *ipv6h;
+	struct ethhdr *ethh;
+	struct udphdr *udph;
+	int len = skb->len;
+	__wsum csum;
+
+	//udp
+	udph = (struct udphdr *) skb_push (skb, sizeof (struct udphdr));
+	udph->source = htons(KD6_CLIENT_PORT);
+	udph->dest = htons(KD6_SERVER_PORT);
+	udph->len = htons(sizeof(struct udphdr)+len);
+	udph->check = 0;
+	csum = csum_partial((char *) udph, sizeof(struct udphdr)+len,0);
+	udph->check = csum_ipv6_magic(saddr, daddr, sizeof(struct udphdr)+len,IPPROTO_UDP,csum);
+	if (!udph->check)
+		udph->check = CSUM_MANGLED_0;
+	//ipv6
+	ipv6h = (struct ipv6hdr *) skb_push (skb,sizeof (struct ipv6hdr));
+	memset (ipv6h, 0, sizeof(*ipv6h));
+	ipv6h->version = 6;
+	ipv6h->nexthdr = IPPROTO_UDP;
+	ipv6h->payload_len = htons(sizeof(struct udphdr)+len);
+	ipv6h->daddr = *daddr; 
+	ipv6h->saddr = *saddr;
+	ipv6h->hop_limit = 255;
+
+
+	ethh = (struct ethhdr *) skb_push (skb, sizeof(struct ethhdr)); 
+	ethh->h_proto = htons(ETH_P_IPV6); 
+	memcpy(ethh->h_source, skb->dev->dev_addr, ETH_ALEN);
+	memcpy (ethh->h_dest, dest_hw, ETH_ALEN);
+}
+
+/*
+ *  Build the complete frame of a message: Ethernet, IPv6 and UDP headers,
+ *  DUID and options. Only called when the message or the transaction
+ *  changes, retransmissions reuse the result. '*keep' is cleared when the
+ *  device has no usable source address, e.g. it lost it since
+ *  kd6_xmit_dev() checked: the frame then goes out from :: and is not
+ *  reused.
+ */
+static struct sk_buff *kd6_tmpl_build(struct kd6_device *d, u8 msg_type,
+		const u8 *xid, bool *keep)
+{
+	struct kd6_net *kn = d->kn;
+	struct sk_buff *skb;
+	struct dhcpv6_packet kd6_pkt_func;
+	struct in6_addr saddr = KD6_LINK_NULL;
+	const struct in6_addr *daddr = &KD6_LINK_LOCAL_MULTICAST;
+	const u8 *dest_hw = kd6_all_servers_hw;
+	int len, time_off;
+
+	len = kd6_msg_len(msg_type, rapid_commit, &d->server_id);
+	if (!len) {
+		pr_err("KD6:Error-unsupported msgtype");
+		return NULL;
+	}
+
+	/* RENEW goes straight to the server that granted the lease */
+	if (msg_type == KD6_RENEW) {
+		daddr = &d->servaddr;
+		dest_hw = d->servaddr_hw;
+	}
+
+	/* Allocate packet */
+	skb = kd6_msg_alloc(d->dev, len, GFP_KERNEL);
+	if (!skb)
+		return NULL;
+
+	//dhcpv6, all layouts start at the payload
+	kd6_pkt_func.kd6_sol = (void *)skb->data;
+	kd6_pkt_func.kd6_req = (void *)skb->data;
+	kd6_pkt_func.kd6_reb = (void *)skb->data;
+	time_off = kd6_options_send_if(msg_type, kd6_pkt_func, d->dev->dev_addr,
+			&d->server_id, &d->ia_prefix, xid, rapid_commit);
+	*keep = !ipv6_dev_get_saddr(kn->net, d->dev, daddr, 0, &saddr);
+	kd6_msg_push_headers(skb, &saddr, daddr, dest_hw);
+
+	d->tmpl_type = msg_type;
+	memcpy(d->tmpl_xid, xid, sizeof(d->tmpl_xid));
+	d->tmpl_time_off = sizeof(struct ethhdr) + sizeof(struct ipv6hdr) +
+		sizeof(struct udphdr) + time_off;
+	return skb;
+}
+
+static void kd6_tmpl_free(struct kd6_device *d)
+{
+	kfree_skb(d->tmpl);
+	d->tmpl = NULL;
+}
+
+/*
+ *  Send a message of the transaction 'xid'. The frame is copied from the
+ *  device's template, rebuilt only when the message, the xid or the link
+ *  addresses changed; Elapsed Time (in hundredths of a second) and the UDP
+ *  checksum are then patched in place. Called from kd6_wq only.
+ */
+static void kd6_send_if(struct kd6_device *d, u8 msg_type, const u8 *xid, unsigned long jiffies_diff)
+{
+	struct sk_buff *skb;
+	struct udphdr *udph;
+	__be16 *time, elapsed;
+	int gen = atomic_read(&kd6_tmpl_gen);
+	bool retrans, keep;
+
+	/* Set by the last build, even one that was not kept */
+	retrans = d->tmpl_type == msg_type &&
+		!memcmp(d->tmpl_xid, xid, sizeof(d->tmpl_xid));
+	if (d->tmpl && (!retrans || d->tmpl_gen != gen))
+		kd6_tmpl_free(d);
+
+	if (!d->tmpl) {
+		skb = kd6_tmpl_build(d, msg_type, xid, &keep);
+		if (!skb)
+			goto err;
+		if (keep) {
+			d->tmpl = skb;
+			d->tmpl_gen = gen;
+		}
+	}
+	if (d->tmpl) {
+		/* The copy gets patched, a clone would share the template's data */
+		skb = skb_copy(d->tmpl, GFP_KERNEL);
+		if (!skb)
+			goto err;
+	}
+
+	elapsed = htons(min_t(unsigned int, jiffies_to_msecs(jiffies_diff) / 10, 0xffff));
+	time = (__be16 *)(skb->data + d->tmpl_time_off);
+	udph = (struct udphdr *)(skb->data + sizeof(struct ethhdr) + sizeof(struct ipv6hdr));
+	csum_replace2(&udph->check, *time, elapsed);
+	if (!udph->check)
+		udph->check = CSUM_MANGLED_0;
+	*time = elapsed;
+
+	if (dev_queue_xmit(skb) < 0) {
+		printk("KD6: Error-dev_queue_xmit failed");
+		goto err;
+	}
+	trace_kd6_tx(d->dev, msg_type, kd6_xid_key(xid),
+			jiffies_to_msecs(jiffies_diff));
+
+	switch (msg_type) {
+		case KD6_SOLICIT:
+			KD6_INC_STATS(KD6_STAT_TX_SOLICIT);
+			break;
+		case KD6_REQUEST:
+			KD6_INC_STATS(KD6_STAT_TX_REQUEST);
+			break;
+		case KD6_RENEW:
+			KD6_INC_STATS(KD6_STAT_TX_RENEW);
+			break;
+		default:
+			KD6_INC_STATS(KD6_STAT_TX_REBIND);
+			break;
+	}
+	if (retrans)
+		KD6_INC_STATS(KD6_STAT_TX_RETRANS);
+	return;
+
+err:
+	KD6_INC_STATS(KD6_STAT_TX_ERR);
+}
+
+/*
+ *  Emulation of many requesting routers, to load test delegating servers
+ *  the way a power outage does. With 'emulate' set, the initial namespace
+ *  runs that many virtual routers on the 'emulate_dev' interfaces instead
+ *  of the client. Each has its own DUID and IAID, made from a made-up
+ *  link-layer address, and its own xid; they share the address of their
+ *  interface, so the replies come back to the client socket. One timer
+ *  wheel drives them all: SOLICITs paced at 'emulate_rate' a second,
+ *  retransmissions, and, with 'emulate_period', a reboot that long after
+ *  binding. The results are in debugfs kd6/emulate.
+ */
+struct kd6_emu_cpe {
+	struct hlist_node wheel_node;	/* In the slot of its next action */
+	struct hlist_node xid_node;	/* In the xid hash while waiting */
+	unsigned long due;		/* Tick of its next action */
+	unsigned long start;		/* SOLICIT sent, in jiffies */
+	unsigned long msg;		/* First transmission of the message */
+	unsigned long timeout;		/* Current retransmission timeout */
+	u8 state;			/* IDLE, SOLICIT, REQUEST or BOUND */
+	u8 retries;			/* Transmissions left */
+	u8 dev;				/* Index in kd6_emu.devs */
+	u8 xid[3];
+	u8 hw[ETH_ALEN];		/* Made up, gives the DUID and IAID */
+	struct dhcpv6_server_id server_id;
+	struct dhcpv6_ia_prefix ia_prefix;
+};
+
+struct kd6_emu {
+	spinlock_t lock;		/* Taken after kn->lock */
+	struct timer_list timer;	/* Turns the wheel */
+	bool stopping;
+	unsigned long base;		/* jiffies of tick 0 */
+	unsigned long clock;		/* Next tick to run */
+	unsigned long credit;		/* SOLICITs allowed, times HZ */
+	int ndevs;
+	struct net_device *devs[KD6_EMU_MAX_DEVS];
+	struct in6_addr saddr[KD6_EMU_MAX_DEVS]; /* Their link-local addresses */
+	struct kd6_emu_cpe *cpes;
+	unsigned int ncpes;
+	struct hlist_head wheel[1 << KD6_EMU_WHEEL_BITS];
+	struct hlist_head *xid_hash;	/* 1 << KD6_EMU_XID_BITS buckets */
+
+	/* Results */
+	u64 solicit, request, retrans, tx_err;
+	u64 advertise, reply, noprefix, bound, failed;
+	u64 solicit_sec;		/* SOLICITs at sec_start */
+	unsigned long sec_start;
+	unsigned int rate;		/* SOLICITs during the last second */
+	u32 latency[KD6_EMU_LAT_MAX + 1]; /* SOLICIT to REPLY, in ms */
+};
+
+static struct hlist_head *kd6_emu_bucket(struct kd6_emu *e, const u8 *xid)
+{
+	return &e->xid_hash[kd6_xid_key(xid) & ((1 << KD6_EMU_XID_BITS) - 1)];
+}
+
+static struct kd6_emu_cpe *kd6_emu_lookup(struct kd6_emu *e, const u8 *xid)
+{
+	struct kd6_emu_cpe *c;
+
+	hlist_for_each_entry(c, kd6_emu_bucket(e, xid), xid_node)
+		if (!memcmp(c->xid, xid, sizeof(c->xid)))
+			return c;
+	return NULL;
+}
+
+/*
+ *  Run the router 'delay' jiffies from now, on the first tick after.
+ *  Called with e->lock held, like everything below.
+ */
+static void kd6_emu_arm(struct kd6_emu *e, struct kd6_emu_cpe *c,
+		unsigned long delay)
+{
+	c->due = e->clock + DIV_ROUND_UP(delay, KD6_EMU_TICK);
+	hlist_del_init(&c->wheel_node);
+	hlist_add_head(&c->wheel_node,
+			&e->wheel[c->due & ((1 << KD6_EMU_WHEEL_BITS) - 1)]);
+}
+
+static void kd6_emu_send(struct kd6_emu *e, struct kd6_emu_cpe *c, u8 msg_type)
+{
+	struct net_device *dev = e->devs[c->dev];
+	struct dhcpv6_packet pkt;
+	struct sk_buff *skb;
+	unsigned int elapsed;
+	int len = kd6_msg_len(msg_type, rapid_commit, &c->server_id);
+	int time_off;
+
+	skb = kd6_msg_alloc(dev, len, GFP_ATOMIC);
+	if (!skb) {
+		e->tx_err++;
+		return;
+	}
+	pkt.kd6_sol = (void *)skb->data;
+	pkt.kd6_req = (void *)skb->data;
+	pkt.kd6_reb = (void *)skb->data;
+	time_off = kd6_options_send_if(msg_type, pkt, c->hw, &c->server_id,
+			&c->ia_prefix, c->xid, rapid_commit);
+	elapsed = jiffies_to_msecs(jiffies - c->start) / 10;
+	*(__be16 *)(skb->data + time_off) = htons(min(elapsed, 0xffffU));
+	kd6_msg_push_headers(skb, &e->saddr[c->dev], &KD6_LINK_LOCAL_MULTICAST,
+			kd6_all_servers_hw);
+	if (dev_queue_xmit(skb) < 0)
+		e->tx_err++;
+}
+
+/*
+ *  Send the first message of a state and wait for the answer.
+ */
+static void kd6_emu_enter(struct kd6_emu *e, struct kd6_emu_cpe *c, u8 state)
+{
+	c->state = state;
+	c->msg = jiffies;
+	c->timeout = KD6_BASE_TIMEOUT;
+	c->retries = KD6_SEND_RETRIES;
+	if (state == KD6_STATE_SOLICIT) {
+		e->solicit++;
+		kd6_emu_send(e, c, KD6_SOLICIT);
+	} else {
+		e->request++;
+		kd6_emu_send(e, c, KD6_REQUEST);
+	}
+	kd6_emu_arm(e, c, c->timeout);
+}
+
+/*
+ *  Back to square one: now if rebooting, after a while if giving up.
+ */
+static void kd6_emu_reset(struct kd6_emu *e, struct kd6_emu_cpe *c,
+		unsigned long delay)
+{
+	hlist_del_init(&c->xid_node);
+	c->state = KD6_STATE_IDLE;
+	kd6_emu_arm(e, c, delay);
+}
+
+/*
+ *  The router's time has come: boot, retransmit, give up or reboot.
+ */
+static void kd6_emu_run(struct kd6_emu *e, struct kd6_emu_cpe *c)
+{
+	u32 x;
+
+	switch (c->state) {
+		case KD6_STATE_IDLE:
+			if (e->credit < HZ) {
+				kd6_emu_arm(e, c, 0);
+				break;
+			}
+			e->credit -= HZ;
+			do {
+				x = prandom_u32();
+				c->xid[0] = x >> 16;
+				c->xid[1] = x >> 8;
+				c->xid[2] = x;
+			} while (kd6_emu_lookup(e, c->xid));
+			hlist_add_head(&c->xid_node, kd6_emu_bucket(e, c->xid));
+			c->start = jiffies;
+			kd6_emu_enter(e, c, KD6_STATE_SOLICIT);
+			break;
+
+		case KD6_STATE_SOLICIT:
+		case KD6_STATE_REQUEST:
+			if (!--c->retries) {
+				e->failed++;
+				kd6_emu_reset(e, c, KD6_EMU_BACKOFF);
+				break;
+			}
+			e->retrans++;
+			kd6_emu_send(e, c, c->state == KD6_STATE_SOLICIT ?
+					KD6_SOLICIT : KD6_REQUEST);
+			c->timeout = min(c->timeout KD6_TIMEOUT_MULT,
+					(unsigned long)KD6_TIMEOUT_MAX);
+			kd6_emu_arm(e, c, c->timeout);
+			break;
+
+		case KD6_STATE_BOUND:
+			kd6_emu_reset(e, c, 0);
+			break;
+	}
+}
+
+static void kd6_emu_tick(struct timer_list *t)
+{
+	struct kd6_emu *e = from_timer(e, t, timer);
+	unsigned long now = (jiffies - e->base) / KD6_EMU_TICK;
+	struct kd6_emu_cpe *c;
+	struct hlist_node *tmp;
+	struct hlist_head *slot;
+
+	spin_lock(&e->lock);
+	if (e->stopping) {
+		spin_unlock(&e->lock);
+		return;
+	}
+
+	while ((long)(now - e->clock) >= 0) {
+		/* Paced SOLICITs, up to a second of them */
+		e->credit = min_t(unsigned long,
+				e->credit + (unsigned long)emulate_rate * KD6_EMU_TICK,
+				(unsigned long)emulate_rate * HZ);
+		slot = &e->wheel[e->clock & ((1 << KD6_EMU_WHEEL_BITS) - 1)];
+		/* Anything armed while running the slot goes to a later one */
+		e->clock++;
+		hlist_for_each_entry_safe(c, tmp, slot, wheel_node) {
+			if ((long)(c->due - (e->clock - 1)) > 0)
+				continue;
+			hlist_del_init(&c->wheel_node);
+			kd6_emu_run(e, c);
+		}
+	}
+
+	if (time_after_eq(jiffies, e->sec_start + HZ)) {
+		e->rate = e->solicit - e->solicit_sec;
+		e->solicit_sec = e->solicit;
+		e->sec_start = jiffies;
+	}
+	mod_timer(&e->timer, jiffies + KD6_EMU_TICK);
+	spin_unlock(&e->lock);
+}
+
+/*
+ *  A message for one of the emulated routers? Called from the receive
+ *  path with kn->lock held.
+ */
+static bool kd6_emu_rcv(struct kd6_emu *e, u8 msg_type, const u8 *xid,
+		const struct kd6_reply *r)
+{
+	struct kd6_emu_cpe *c;
+	unsigned int ms;
+
+	spin_lock(&e->lock);
+	c = kd6_emu_lookup(e, xid);
+	if (!c) {
+		spin_unlock(&e->lock);
+		return false;
+	}
+
+	switch (msg_type) {
+		case KD6_ADVERTISE:
+			if (c->state != KD6_STATE_SOLICIT)
+				break;
+			e->advertise++;
+			if (!r->have_prefix || kd6_take_server(&c->server_id, r)) {
+				e->noprefix++;
+				break;
+			}
+			c->ia_prefix = r->ia_prefix;
+			kd6_emu_enter(e, c, KD6_STATE_REQUEST);
+			break;
+
+		case KD6_REPLY:
+			if (c->state != KD6_STATE_REQUEST &&
+					(c->state != KD6_STATE_SOLICIT ||
+					 !rapid_commit || !r->rapid_commit))
+				break;
+			e->reply++;
+			if (!r->have_prefix) {
+				e->noprefix++;
+				e->failed++;
+				kd6_emu_reset(e, c, KD6_EMU_BACKOFF);
+				break;
+			}
+			ms = jiffies_to_msecs(jiffies - c->start);
+			e->latency[min_t(unsigned int, ms, KD6_EMU_LAT_MAX)]++;
+			e->bound++;
+			hlist_del_init(&c->xid_node);
+			c->state = KD6_STATE_BOUND;
+			if (emulate_period)
+				kd6_emu_arm(e, c, emulate_period * HZ);
+			else
+				hlist_del_init(&c->wheel_node);
+			break;
+	}
+	spin_unlock(&e->lock);
+	return true;
+}
+
+/*
+ *  Open the 'emulate_dev' interfaces and line up the routers, their
+ *  SOLICITs spread at 'emulate_rate' a second. Called from kd6_wq.
+ */
+static int kd6_emu_start(struct kd6_net *kn)
+{
+	struct kd6_emu *e;
+	struct kd6_emu_cpe *c;
+	struct net_device *dev;
+	char *names, *p, *name;
+	unsigned int i;
+	int err = -EINVAL;
+
+	if (!emulate_rate || emulate > KD6_EMU_MAX || !emulate_dev) {
+		pr_err("KD6: Emulation needs emulate_dev, a rate and at most %u routers\n",
+				KD6_EMU_MAX);
+		return -EINVAL;
+	}
+	e = kvzalloc(sizeof(*e), GFP_KERNEL);
+	if (!e)
+		return -ENOMEM;
+	spin_lock_init(&e->lock);
+
+	names = p = kstrdup(emulate_dev, GFP_KERNEL);
+	if (!names) {
+		err = -ENOMEM;
+		goto err;
+	}
+	while ((name = strsep(&p, ",")) && e->ndevs < KD6_EMU_MAX_DEVS) {
+		if (!*name)
+			continue;
+		dev = dev_get_by_name(kn->net, name);
+		if (!dev) {
+			pr_err("KD6: No device %s to emulate on\n", name);
+			err = -ENODEV;
+			break;
+		}
+		e->devs[e->ndevs] = dev;
+		if (ipv6_get_lladdr(dev, &e->saddr[e->ndevs], IFA_F_TENTATIVE)) {
+			pr_err("KD6: No link-local address on %s\n", name);
+			err = -EADDRNOTAVAIL;
+			dev_put(dev);
+			break;
+		}
+		e->ndevs++;
+		err = 0;
+	}
+	kfree(names);
+	if (err)
+		goto err;
+
+	e->ncpes = emulate;
+	e->cpes = kvcalloc(e->ncpes, sizeof(*e->cpes), GFP_KERNEL);
+	e->xid_hash = kvcalloc(1 << KD6_EMU_XID_BITS, sizeof(*e->xid_hash),
+			GFP_KERNEL);
+	if (!e->cpes || !e->xid_hash) {
+		err = -ENOMEM;
+		goto err;
+	}
+
+	for (i = 0; i < e->ncpes; i++) {
+		c = &e->cpes[i];
+		c->dev = i % e->ndevs;
+		c->hw[0] = 0x02;	/* Locally administered */
+		c->hw[1] = 0xd6;
+		c->hw[2] = i >> 24;
+		c->hw[3] = i >> 16;
+		c->hw[4] = i >> 8;
+		c->hw[5] = i;
+		c->state = KD6_STATE_IDLE;
+		INIT_HLIST_NODE(&c->xid_node);
+		INIT_HLIST_NODE(&c->wheel_node);
+		kd6_emu_arm(e, c, div_u64((u64)i * HZ, emulate_rate));
+	}
+
+	e->base = e->sec_start = jiffies;
+	timer_setup(&e->timer, kd6_emu_tick, 0);
+	mod_timer(&e->timer, jiffies + KD6_EMU_TICK);
+
+	spin_lock_bh(&kn->lock);
+	kn->emu = e;
+	spin_unlock_bh(&kn->lock);
+	pr_info("KD6: Emulating %u requesting routers on %s, %u SOLICITs/s\n",
+			e->ncpes, emulate_dev, emulate_rate);
+	return 0;
+
+err:
+	while (e->ndevs)
+		dev_put(e->devs[--e->ndevs]);
+	kvfree(e->cpes);
+	kvfree(e->xid_hash);
+	kvfree(e);
+	return err;
+}
+
+static void kd6_emu_stop(struct kd6_net *kn)
+{
+	struct kd6_emu *e = kn->emu;
+
+	if (!e)
+		return;
+	/* The receive path looks it up under kn->lock */
+	spin_lock_bh(&kn->lock);
+	kn->emu = NULL;
+	spin_unlock_bh(&kn->lock);
+
+	spin_lock_bh(&e->lock);
+	e->stopping = true;
+	spin_unlock_bh(&e->lock);
+	del_timer_sync(&e->timer);
+
+	pr_info("KD6: Emulation stopped, %llu of %u routers bound, %llu failures\n",
+			e->bound, e->ncpes, e->failed);
+	while (e->ndevs)
+		dev_put(e->devs[--e->ndevs]);
+	kvfree(e->cpes);
+	kvfree(e->xid_hash);
+	kvfree(e);
+}
+
+/*
+ *  The emulation goes away with any of its interfaces.
+ */
+static bool kd6_emu_devs_ok(struct kd6_emu *e)
+{
+	int i;
+
+	for (i = 0; i < e->ndevs; i++)
+		if (e->devs[i]->reg_state != NETREG_REGISTERED)
+			return false;
+	return true;
+}
+
+static bool kd6_emulating(struct kd6_net *kn)
+{
+	return emulate && net_eq(kn->net, &init_net);
+}
+
+/*
+ *  DHCPv6PD init: open the client socket on UDP port 546.
+ *
+ *  The socket stays open while the namespace is enabled and hands every
+ *  datagram to kd6_rcv_pkt() straight from the UDP receive path, so
+ *  forwarded traffic never reaches this module.
+ */
+static int kd6_dhcpv6PD_init(struct kd6_net *kn)
+{
+	struct udp_port_cfg udp_conf;
+	struct udp_tunnel_sock_cfg tunnel_cfg;
+	int err;
+
+	memset(&udp_conf, 0, sizeof(udp_conf));
+	udp_conf.family = AF_INET6;
+	udp_conf.local_ip6 = in6addr_any;
+	udp_conf.local_udp_port = htons(KD6_CLIENT_PORT);
+	udp_conf.ipv6_v6only = 1;
+	udp_conf.use_udp6_rx_checksums = 1;
+
+	err = udp_sock_create(kn->net, &udp_conf, &kn->sock);
+	if (err < 0) {
+		pr_err("KD6: Failed to open UDP port %d, err %d\n",
+				KD6_CLIENT_PORT, err);
+		kn->sock = NULL;
+		return err;
+	}
+
+	memset(&tunnel_cfg, 0, sizeof(tunnel_cfg));
+	tunnel_cfg.encap_type = KD6_UDP_ENCAP;
+	tunnel_cfg.encap_rcv = kd6_rcv_pkt;
+	setup_udp_tunnel_sock(kn->net, kn->sock, &tunnel_cfg);
+
+	return 0;
+}
+
+
+/*
+ *  DHCPv6PD cleanup.
+
+ */
+static void  kd6_dhcpv6PD_cleanup(struct kd6_net *kn)
+{
+	if (kn->sock) {
+		udp_tunnel_sock_release(kn->sock);
+		kn->sock = NULL;
+	}
+}
+
+
+
+
+
+/*
+ *  What is left of the uplink's lease, in seconds. Everything it
+ *  configures downstream, addresses, RAs, routes and delegated prefixes,
+ *  takes its lifetimes from here, so none of it outlives the lease. Zero
+ *  once the lease ran out.
+ */
+static void kd6_lease_left(struct kd6_net *kn, u32 *preferred, u32 *valid)
+{
+	struct kd6_device *u = kn->uplink;
+	u32 elapsed;
+
+	if (!u || kn->withdrawn) {
+		*preferred = *valid = 0;
+		return;
+	}
+	elapsed = div_u64(ktime_to_ns(ktime_sub(ktime_get(), u->lease_start)),
+			NSEC_PER_SEC);
+	*preferred = ntohl(u->ia_prefix.prefered_lifetime);
+	*valid = ntohl(u->ia_prefix.valid_lifetime);
+	if (*preferred != KD6_INFINITY)
+		*preferred = *preferred > elapsed ? *preferred - elapsed : 0;
+	if (*valid != KD6_INFINITY)
+		*valid = *valid > elapsed ? *valid - elapsed : 0;
+}
+
+static int kd6_setup_def_route(struct kd6_net *kn){
+	struct fib6_info *rt = NULL;
+	u32 preferred, valid;
+
+	kd6_lease_left(kn, &preferred, &valid);
+	//need to setup default route, returns the existing one on renewal
+	rt = rt6_add_dflt_router(kn->net, &kn->uplink->servaddr, kn->uplink->dev, ICMPV6_ROUTER_PREF_MEDIUM);
+	trace_kd6_default_route(kn->uplink->dev, &kn->uplink->servaddr, valid,
+			rt ? 0 : -ENOMEM);
+	if (!rt) {
+		pr_info("KD6: failed to add default route\n");
+		return 0;
+	}
+	if (valid == KD6_INFINITY)
+		//set infinite timeout
+		fib6_clean_expires(rt);
+	else
+		//set finite timeout, pushed forward by every renewal
+		fib6_set_expires(rt, jiffies + HZ * addrconf_timeout_fixup(valid, HZ));
+	fib6_info_release(rt);
+	return 0;
+}
+
+/*
+ *  Routes of our own, tagged RTPROT_DHCP: to a prefix through 'gw' on
+ *  'ifindex', on link of 'ifindex' with a NULL 'gw', or unreachable with
+ *  neither. Called with rtnl held.
+ */
+static int kd6_route_add(struct kd6_net *kn, const struct in6_addr *dst,
+		u8 plen, int ifindex, const struct in6_addr *gw)
+{
+	struct fib6_config cfg = {
+		.fc_table	= RT6_TABLE_MAIN,
+		.fc_metric	= IP6_RT_PRIO_USER,
+		.fc_ifindex	= ifindex,
+		.fc_dst		= *dst,
+		.fc_dst_len	= plen,
+		.fc_flags	= RTF_UP,
+		.fc_protocol	= RTPROT_DHCP,
+		.fc_type	= RTN_UNICAST,
+		.fc_nlinfo.nl_net = kn->net,
+	};
+
+	if (gw) {
+		cfg.fc_gateway = *gw;
+		cfg.fc_flags |= RTF_GATEWAY;
+	} else if (!ifindex) {
+		cfg.fc_flags |= RTF_REJECT;
+		cfg.fc_type = RTN_UNREACHABLE;
+	}
+	return ip6_route_add(&cfg, GFP_KERNEL, NULL);
+}
+
+/*
+ *  Remove a route added by kd6_route_add(), looked up the way
+ *  ip6_route_del() does.
+ */
+static int kd6_route_del(struct kd6_net *kn, const struct in6_addr *dst,
+		u8 plen, int ifindex, const struct in6_addr *gw)
+{
+	struct fib6_table *table;
+	struct fib6_node *fn;
+	struct fib6_info *rt;
+
+	table = fib6_get_table(kn->net, RT6_TABLE_MAIN);
+	if (!table)
+		return -ESRCH;
+	rcu_read_lock();
+	fn = fib6_locate(&table->tb6_root, dst, plen, NULL, 0, true);
+	if (fn) {
+		for_each_fib6_node_rt_rcu(fn) {
+			if (rt->fib6_protocol != RTPROT_DHCP)
+				continue;
+			if (!ifindex) {
+				if (!(rt->fib6_flags & RTF_REJECT))
+					continue;
+			} else if (!rt->fib6_nh.nh_dev ||
+					rt->fib6_nh.nh_dev->ifindex != ifindex ||
+					(rt->fib6_flags & RTF_REJECT) ||
+					!!gw != !!(rt->fib6_flags & RTF_GATEWAY) ||
+					(gw && !ipv6_addr_equal(&rt->fib6_nh.nh_gw, gw)))
+				continue;
+			if (!fib6_info_hold_safe(rt))
+				continue;
+			rcu_read_unlock();
+			return ip6_del_rt(kn->net, rt);
+		}
+	}
+	rcu_read_unlock();
+	return -ESRCH;
+}
+
+/*
+ *  addrconf only routes the /64 of a port; a longer subprefix gets a
+ *  route of its own, or the unreachable route of the delegated prefix
+ *  would take the rest of it. Called with rtnl held.
+ */
+static void kd6_port_route_del(struct kd6_device *d)
+{
+	if (!d->route_plen)
+		return;
+	kd6_route_del(d->kn, &d->route, d->route_plen, d->ifindex, NULL);
+	d->route_plen = 0;
+}
+
+static void kd6_port_route_add(struct kd6_device *d)
+{
+	struct in6_addr dst;
+	int err;
+
+	if (!d->slot_len || d->slot_len >= 64)
+		return;
+	ipv6_addr_prefix(&dst, &d->prefix, d->slot_len);
+	if (d->route_plen == d->slot_len && ipv6_addr_equal(&d->route, &dst))
+		return;
+	kd6_port_route_del(d);
+	err = kd6_route_add(d->kn, &dst, d->slot_len, d->ifindex, NULL);
+	if (err && err != -EEXIST) {
+		pr_warn("KD6: No route for %pI6c/%u on %s, error %d\n",
+				&dst, d->slot_len, d->dev->name, err);
+		return;
+	}
+	d->route = dst;
+	d->route_plen = d->slot_len;
+}
+
+/*
+ *  Subprefix allocator: one bit per /64 of the delegated prefix, up to
+ *  2^KD6_MAX_SLOTS_SHIFT of them. A port of length L takes 2^(64-L)
+ *  aligned slots. Its preferred place is derived from a hash of its
+ *  name, so a port gets the same subprefix across restarts as long as
+ *  the delegation stays the same; only on a collision is the bitmap
+ *  searched. The first /64 is kept back unless it is all there is.
+ *  Everything here runs under rtnl.
+ */
+static void kd6_slot_free(struct kd6_device *d)
+{
+	struct kd6_net *kn = d->kn;
+
+	if (!d->slot_len)
+		return;
+	kd6_port_route_del(d);
+	if (kn->slots)
+		bitmap_clear(kn->slots, d->slot, 1U << (64 - d->slot_len));
+	d->slot_len = 0;
+}
+
+/*
+ *  (Re)size the allocator for the uplink's delegation. A new prefix
+ *  renumbers every port.
+ */
+static int kd6_slots_prepare(struct kd6_net *kn)
+{
+	struct kd6_device *d;
+	u8 plen = kn->uplink->ia_prefix.prefix_len;
+	u64 base;
+	int shift;
+	int bkt;
+
+	base = kd6_prefix_base(kn->uplink->ia_prefix.prefix_addr, plen);
+	shift = min(64 - plen, KD6_MAX_SLOTS_SHIFT);
+
+	if (kn->slots && base == kn->slots_base && plen == kn->slots_plen)
+		return 0;
+
+	kd6_pds_flush(kn, 0);
+	hash_for_each(kn->dev_table, bkt, d, node)
+		kd6_slot_free(d);
+	bitmap_free(kn->slots);
+	kn->nslots = 1U << shift;
+	kn->slots = bitmap_zalloc(kn->nslots, GFP_KERNEL);
+	if (!kn->slots)
+		return -ENOMEM;
+	kn->slots_base = base;
+	kn->slots_plen = plen;
+	if (kn->nslots > 1)
+		__set_bit(0, kn->slots);
+	pr_info("KD6: %u subprefixes available in %pI6c/%u\n", kn->nslots,
+			kn->uplink->ia_prefix.prefix_addr, plen);
+	return 0;
+}
+
+/*
+ *  Take 'n' aligned slots, at 'start' unless some of them are taken there.
+ *  Returns the first one.
+ */
+static int kd6_slots_take(struct kd6_net *kn, unsigned int start,
+		unsigned int n)
+{
+	/* Preferred place first, a search only when it is taken */
+	if (find_next_bit(kn->slots, start + n, start) < start + n) {
+		start = bitmap_find_next_zero_area(kn->slots, kn->nslots, 0,
+				n, n - 1);
+		if (start >= kn->nslots)
+			return -ENOSPC;
+	}
+	bitmap_set(kn->slots, start, n);
+	return start;
+}
+
+static int kd6_slot_alloc(struct kd6_device *d)
+{
+	struct kd6_net *kn = d->kn;
+	u8 len = kd6_port_len(port_size, d->dev->name);
+	unsigned int n;
+	int start;
+
+	/* The whole delegation would not fit either, the first /64 is kept */
+	if (64 - len > KD6_MAX_SLOTS_SHIFT || (1U << (64 - len)) >= kn->nslots)
+		len = 64;
+	n = 1U << (64 - len);
+
+	start = kd6_slots_take(kn, kd6_slot_pref(d->dev->name, kn->nslots, n), n);
+	if (start < 0)
+		return start;
+	d->slot = start;
+	d->slot_len = len;
+	return 0;
+}
+
+/*
+ *  Configure the /64 of a downstream port with the lifetimes of the
+ *  lease, and join the groups it listens to. Called with rtnl held.
+ */
+static void kd6_port_apply(struct kd6_device *d, const struct in6_addr *prefix,
+		__be32 valid, __be32 preferred)
+{
+	struct kd6_net *kn = d->kn;
+	struct prefix_info pinfo;
+	bool sllao = false;
+
+	memset(&pinfo, 0, sizeof(pinfo));
+	pinfo.prefix_len = 64;
+	pinfo.valid = valid;
+	pinfo.prefered = preferred;
+	pinfo.onlink = 1;
+	pinfo.autoconf = 1; 
+	pinfo.prefix = *prefix;
+	if (!ipv6_addr_equal(&d->prefix, &pinfo.prefix))
+		kd6_ra_tmpl_free(d);
+	d->prefix = pinfo.prefix;
+
+	trace_kd6_prefix_assign(d->dev, &pinfo.prefix, d->slot_len,
+			ntohl(pinfo.valid), ntohl(pinfo.prefered));
+
+	addrconf_prefix_rcv(d->dev, (u8 *)&pinfo, sizeof(pinfo), sllao);
+	if (valid)
+		kd6_port_route_add(d);
+	else
+		kd6_port_route_del(d);
+
+	/* Router Solicitations go to all-routers */
+	if (!d->ra_mc && !ipv6_dev_mc_inc(d->dev, &in6addr_linklocal_allrouters))
+		d->ra_mc = true;
+	/* and the messages of its DHCPv6 clients to ff02::1:2 */
+	if (kn->srv_sock && !d->relay_mc &&
+			!ipv6_dev_mc_inc(d->dev, &KD6_LINK_LOCAL_MULTICAST))
+		d->relay_mc = true;
+}
+
+/*
+ *  Give a downstream port its subprefix out of the delegated prefix and
+ *  configure the first /64 of it on the port, when it comes up after the
+ *  others. Called with rtnl held.
+ */
+static void kd6_setup_dev(struct kd6_device *d){
+	struct kd6_net *kn = d->kn;
+	struct in6_addr prefix;
+	u32 preferred, valid;
+
+	if (!d->slot_len && kd6_slot_alloc(d)) {
+		pr_warn("KD6: No subprefix left for %s\n", d->dev->name);
+		return;
+	}
+	kd6_subprefix(kn->slots_base, d->slot, &prefix);
+	kd6_lease_left(kn, &preferred, &valid);
+	kd6_port_apply(d, &prefix, htonl(valid), htonl(preferred));
+}
+
+/*
+ *  Everything a lease configures, worked out before any of it is
+ *  applied: the /64 of every running port, the unreachable route of the
+ *  delegated prefix and the default route. Applied within one rtnl
+ *  section, renumbering hundreds of ports is a single transaction to the
+ *  rest of the system.
+ */
+struct kd6_plan {
+	struct in6_addr aggr;		/* Delegated prefix */
+	u8 aggr_plen;
+	__be32 valid, preferred;	/* Lifetimes of the lease */
+	int renumbered;			/* Ports getting a new /64 */
+	int nports, max;
+	struct kd6_plan_port {
+		struct kd6_device *d;
+		struct in6_addr prefix;
+	} port[];
+};
+
+/*
+ *  Fill in the plan, allocating the subprefixes. Nothing is configured
+ *  yet. Called with rtnl held.
+ */
+static void kd6_plan_build(struct kd6_net *kn, struct kd6_plan *plan)
+{
+	struct kd6_device *u = kn->uplink, *d;
+	struct kd6_plan_port *p;
+	u32 preferred, valid;
+	int bkt;
+
+	plan->aggr_plen = u->ia_prefix.prefix_len;
+	ipv6_addr_prefix(&plan->aggr,
+			(const struct in6_addr *)u->ia_prefix.prefix_addr,
+			plan->aggr_plen);
+	kd6_lease_left(kn, &preferred, &valid);
+	plan->valid = htonl(valid);
+	plan->preferred = htonl(preferred);
+
+	if (kd6_slots_prepare(kn)) {
+		pr_err("KD6: No memory for the subprefix allocator\n");
+		return;
+	}
+	hash_for_each(kn->dev_table, bkt, d, node) {
+		if (d == u || !d->up || plan->nports == plan->max)
+			continue;
+		if (!d->slot_len && kd6_slot_alloc(d)) {
+			pr_warn("KD6: No subprefix left for %s\n", d->dev->name);
+			continue;
+		}
+		p = &plan->port[plan->nports++];
+		p->d = d;
+		kd6_subprefix(kn->slots_base, d->slot, &p->prefix);
+		if (!ipv6_addr_equal(&d->prefix, &p->prefix))
+			plan->renumbered++;
+	}
+}
+
+static void kd6_aggr_del(struct kd6_net *kn)
+{
+	if (!kn->aggr_routed)
+		return;
+	kd6_route_del(kn, &kn->aggr, kn->aggr_plen, 0, NULL);
+	kn->aggr_routed = false;
+}
+
+/*
+ *  Configure what the plan says. Called with rtnl held.
+ */
+static void kd6_plan_apply(struct kd6_net *kn, const struct kd6_plan *plan)
+{
+	const struct kd6_plan_port *p;
+	int err;
+
+	for (p = plan->port; p < plan->port + plan->nports; p++)
+		kd6_port_apply(p->d, &p->prefix, plan->valid, plan->preferred);
+
+	/* What no port or router got is unreachable, rather than sent back up */
+	if (kn->aggr_plen != plan->aggr_plen ||
+			!ipv6_addr_equal(&kn->aggr, &plan->aggr))
+		kd6_aggr_del(kn);
+	if (!kn->aggr_routed && plan->aggr_plen < 64) {
+		kn->aggr = plan->aggr;
+		kn->aggr_plen = plan->aggr_plen;
+		err = kd6_route_add(kn, &kn->aggr, kn->aggr_plen, 0, NULL);
+		kn->aggr_routed = !err || err == -EEXIST;
+		if (!kn->aggr_routed)
+			pr_warn("KD6: No unreachable route for %pI6c/%u, error %d\n",
+					&kn->aggr, kn->aggr_plen, err);
+	}
+
+	kd6_setup_def_route(kn);
+	if (plan->renumbered)
+		pr_info("KD6: %d of %d ports renumbered in %pI6c/%u\n",
+				plan->renumbered, plan->nports, &plan->aggr,
+				plan->aggr_plen);
+}
+
+/*
+ *  Configure the running downstream ports, the routes and the DNS
+ *  options from the uplink's lease, or refresh them after a renewal.
+ */
+static int kd6_setup_if(struct kd6_net *kn){
+	struct kd6_device *d;
+	struct kd6_plan *plan;
+	bool dns_changed;
+	int bkt, n = 0;
+
+	/* DNS options of the lease, served as they are downstream */
+	spin_lock_bh(&kn->lock);
+	d = kn->uplink;
+	dns_changed = kn->dns_len != d->dns_len ||
+		memcmp(kn->dns, d->dns, d->dns_len);
+	if (dns_changed) {
+		kn->dns_len = d->dns_len;
+		memcpy(kn->dns, d->dns, d->dns_len);
+	}
+	spin_unlock_bh(&kn->lock);
+	/* The RAs take the new lifetimes, and the DNS options if they changed */
+	atomic_inc(&kd6_ra_gen);
+
+	/* The table only changes from kd6_wq, where we are */
+	hash_for_each(kn->dev_table, bkt, d, node)
+		if (d != kn->uplink && d->up)
+			n++;
+	plan = kvzalloc(struct_size(plan, port, n), GFP_KERNEL);
+	if (!plan) {
+		pr_err("KD6: No memory to configure %d ports\n", n);
+		return -ENOMEM;
+	}
+	plan->max = n;
+
+	rtnl_lock();
+	kd6_plan_build(kn, plan);
+	kd6_plan_apply(kn, plan);
+	rtnl_unlock();
+	kvfree(plan);
+	return 0;
+}
+
+
+/*
+ *  Retransmission timer: hand over to the workqueue, the packet is built
+ *  with sleeping allocations.
+ */
+static enum hrtimer_restart kd6_rtx_timer_fn(struct hrtimer *timer)
+{
+	struct kd6_device *d = container_of(timer, struct kd6_device, rtx_timer);
+
+	set_bit(KD6_DEV_XMIT, &d->flags);
+	queue_work(kd6_wq, &d->kn->xmit_work);
+	return HRTIMER_NORESTART;
+}
+
+/*
+ *  Lease timer: T1, T2 or the end of the valid lifetime has been reached.
+ */
+static enum hrtimer_restart kd6_lease_timer_fn(struct hrtimer *timer)
+{
+	struct kd6_device *d = container_of(timer, struct kd6_device, lease_timer);
+
+	set_bit(KD6_DEV_LEASE, &d->flags);
+	queue_work(kd6_wq, &d->kn->lease_work);
+	return HRTIMER_NORESTART;
+}
+
+/*
+ *  The uplink's lease ran out: take back what it configured downstream
+ *  rather than leave hosts with a prefix that leads nowhere. A last RA
+ *  with zero lifetimes deprecates their addresses and drops us as their
+ *  router; the ports' own addresses, the unreachable route and the
+ *  delegated prefixes go. Ports keep their slots, in case the same
+ *  prefix comes back. From kd6_wq.
+ */
+static void kd6_lease_withdraw(struct kd6_net *kn)
+{
+	struct kd6_device *d;
+	int bkt;
+
+	kn->withdrawn = true;
+	atomic_inc(&kd6_ra_gen);
+	rtnl_lock();
+	hash_for_each(kn->dev_table, bkt, d, node) {
+		if (d == kn->uplink || !d->slot_len)
+			continue;
+		hrtimer_cancel(&d->ra_timer);
+		if (d->up)
+			kd6_nd_network_prefix_send(d);
+		kd6_port_apply(d, &d->prefix, 0, 0);
+	}
+	kd6_aggr_del(kn);
+	kd6_pds_flush(kn, 0);
+	rtnl_unlock();
+}
+
+static void kd6_lease_work_fn(struct work_struct *work)
+{
+	struct kd6_net *kn = container_of(work, struct kd6_net, lease_work);
+	struct kd6_device *d;
+	bool expired;
+	int bkt;
+
+	hash_for_each(kn->dev_table, bkt, d, node) {
+		if (!test_and_clear_bit(KD6_DEV_LEASE, &d->flags))
+			continue;
+		expired = false;
+
+		spin_lock_bh(&kn->lock);
+		/*
+		 * A deadline of the previous state, e.g. T2 firing as a REPLY
+		 * moved the device back to BOUND: the timer is armed again
+		 * already, for the deadline of this one.
+		 */
+		if (ktime_before(ktime_get(), d->lease_due)) {
+			spin_unlock_bh(&kn->lock);
+			continue;
+		}
+		switch (d->state) {
+			case KD6_STATE_BOUND:
+				kd6_enter_state(d, KD6_STATE_RENEW);
+				break;
+			case KD6_STATE_RENEW:
+				kd6_enter_state(d, KD6_STATE_REBIND);
+				break;
+			case KD6_STATE_REBIND:
+				pr_warn("KD6: Lease on %pI64 expired on %s, soliciting again\n",
+						&(d->ia_prefix.prefix_addr), d->dev->name);
+				kd6_enter_state(d, KD6_STATE_SOLICIT);
+				expired = d == kn->uplink;
+				break;
+			default:
+				break;
+		}
+		spin_unlock_bh(&kn->lock);
+		if (expired && kn->configured && !kn->withdrawn)
+			kd6_lease_withdraw(kn);
+	}
+}
+
+/*
+ *  Take T1/T2 from the IA_PD and the valid lifetime from its prefix.
+ *  T1/T2 of zero leave the choice to us: 0.5 and 0.8 times the preferred
+ *  lifetime, as suggested by section 22.4 of RFC 3315.
+ */
+static void kd6_lease_update(struct kd6_device *d)
+{
+	u32 t1, t2, preferred;
+
+	memcpy(&t1, d->ia_pd.t1, sizeof(t1));
+	memcpy(&t2, d->ia_pd.t2, sizeof(t2));
+	t1 = ntohl(t1);
+	t2 = ntohl(t2);
+	preferred = ntohl(d->ia_prefix.prefered_lifetime);
+	d->valid = ntohl(d->ia_prefix.valid_lifetime);
+
+	if (!t1 || !t2 || t1 > t2) {
+		t1 = preferred == KD6_INFINITY ? KD6_INFINITY : preferred / 2;
+		t2 = preferred == KD6_INFINITY ? KD6_INFINITY : preferred / 5 * 4;
+	}
+	d->t1 = t1;
+	d->t2 = t2;
+	d->lease_start = ktime_get();
+	d->lease_real = ktime_get_real_seconds();
+}
+
+/*
+ *  Arm the lease timer 'secs' after the lease was granted. Called with
+ *  kn->lock held.
+ */
+static void kd6_lease_arm(struct kd6_device *d, u32 secs)
+{
+	if (secs == KD6_INFINITY) {
+		d->lease_due = KTIME_MAX;
+		return;
+	}
+	d->lease_due = ktime_add(d->lease_start, ktime_set(secs, 0));
+	hrtimer_start(&d->lease_timer, d->lease_due, HRTIMER_MODE_ABS);
+}
+
+/*
+ *  Take the device out of its transaction: no more replies are matched
+ *  and no timer is left running. Not for timer context.
+ */
+static void kd6_stop_xact(struct kd6_device *d)
+{
+	struct kd6_net *kn = d->kn;
+
+	spin_lock_bh(&kn->lock);
+	d->state = KD6_STATE_IDLE;
+	hash_del(&d->xid_node);
+	spin_unlock_bh(&kn->lock);
+
+	hrtimer_cancel(&d->rtx_timer);
+	hrtimer_cancel(&d->lease_timer);
+	kd6_tmpl_free(d);
+}
+
+/*
+ *  Send (or resend) the message of the device's current state and arm
+ *  its retransmission timer. Right after link up the link-local address
+ *  is still tentative, and a message from :: could not be answered: the
+ *  message then waits for DAD, polling, without using up a transmission.
+ */
+static void kd6_xmit_dev(struct kd6_device *d)
+{
+	struct kd6_net *kn = d->kn;
+	enum kd6_state state;
+	unsigned long elapsed, timeout;
+	struct in6_addr lladdr;
+	bool tentative;
+	u8 xid[3];
+
+	tentative = ipv6_get_lladdr(d->dev, &lladdr, IFA_F_TENTATIVE) != 0;
+
+	spin_lock_bh(&kn->lock);
+	state = d->state;
+	if (!kn->running || (state != KD6_STATE_SOLICIT && state != KD6_STATE_REQUEST &&
+			state != KD6_STATE_RENEW && state != KD6_STATE_REBIND)) {
+		spin_unlock_bh(&kn->lock);
+		return;
+	}
+	if (tentative) {
+		hrtimer_start(&d->rtx_timer,
+				ms_to_ktime(jiffies_to_msecs(KD6_DAD_POLL)),
+				HRTIMER_MODE_REL);
+		spin_unlock_bh(&kn->lock);
+		return;
+	}
+	if (!d->retries) {
+		/*
+		 *  Only REQUEST is bounded (REQ_MAX_RC); SOLICIT, RENEW and
+		 *  REBIND go on until a reply or the lease timer moves us.
+		 *  Section 18.2.2 of RFC 8415: start over with a SOLICIT.
+		 */
+		kd6_enter_state(d, KD6_STATE_SOLICIT);
+		spin_unlock_bh(&kn->lock);
+		pr_info("KD6: DHCPv6_PD REQUEST timed out on %s\n", d->dev->name);
+		return;
+	}
+	if (d->retries > 0)
+		d->retries--;
+	elapsed = jiffies - d->start_jiffies;
+	memcpy(xid, d->xid, sizeof(xid));
+	timeout = d->timeout;
+	d->timeout = d->timeout KD6_TIMEOUT_MULT;
+	if (state == KD6_STATE_RENEW || state == KD6_STATE_REBIND) {
+		if (d->timeout > KD6_REN_MAX_RT)
+			d->timeout = KD6_REN_MAX_RT;
+	} else if (state == KD6_STATE_SOLICIT) {
+		if (d->timeout > KD6_SOL_MAX_RT)
+			d->timeout = KD6_SOL_MAX_RT;
+	} else if (d->timeout > KD6_TIMEOUT_MAX)
+		d->timeout = KD6_TIMEOUT_MAX;
+	spin_unlock_bh(&kn->lock);
+
+	switch (state) {
+		case KD6_STATE_SOLICIT:
+			kd6_send_if(d, KD6_SOLICIT, xid, elapsed);
+			break;
+		case KD6_STATE_REQUEST:
+			kd6_send_if(d, KD6_REQUEST, xid, elapsed);
+			break;
+		case KD6_STATE_RENEW:
+			kd6_send_if(d, KD6_RENEW, xid, elapsed);
+			break;
+		default:
+			kd6_send_if(d, KD6_REBIND, xid, elapsed);
+			break;
+	}
+
+	/* A reply may have moved us on while we were sending */
+	spin_lock_bh(&kn->lock);
+	if (d->state == state && kn->running)
+		hrtimer_start(&d->rtx_timer,
+				ms_to_ktime(jiffies_to_msecs(timeout)),
+				HRTIMER_MODE_REL);
+	spin_unlock_bh(&kn->lock);
+}
+
+static void kd6_xmit_work_fn(struct work_struct *work)
+{
+	struct kd6_net *kn = container_of(work, struct kd6_net, xmit_work);
+	struct kd6_device *d;
+	int bkt;
+
+	hash_for_each(kn->dev_table, bkt, d, node)
+		if (test_and_clear_bit(KD6_DEV_XMIT, &d->flags))
+			kd6_xmit_dev(d);
+}
+
+/*
+ *  First REPLY received: configure the interfaces from the uplink's lease
+ *  and start advertising. Later ones refresh the lifetimes.
+ */
+static void kd6_bound_work_fn(struct work_struct *work)
+{
+	struct kd6_net *kn = container_of(work, struct kd6_net, bound_work);
+	struct kd6_device *d = kn->uplink, *p;
+	int bkt;
+
+	/* The uplink went away in the meantime */
+	if (!d)
+		return;
+	if (kn->configured && kn->withdrawn) {
+		/* A new lease after the last one ran out: advertise again */
+		pr_info("KD6: New lease on %pI64 after expiry\n",
+				&(d->ia_prefix.prefix_addr));
+		kn->withdrawn = false;
+		kd6_setup_if(kn);
+		hash_for_each(kn->dev_table, bkt, p, node)
+			if (p != d && p->up)
+				kd6_ra_start(p);
+		return;
+	}
+	if (kn->configured) {
+		/* Renewed or rebound: refresh the lifetimes */
+		pr_info("KD6: Lease on %pI64 extended, T1 %u T2 %u valid %u\n",
+				&(d->ia_prefix.prefix_addr),
+				d->t1, d->t2, d->valid);
+		kd6_setup_if(kn);
+		return;
+	}
+
+	pr_info("KD6: Got DHCPv6 REPLY from %pI64 on %s, the IPv6 GUNPs offered: %pI64\n",
+			&(d->servaddr), d->dev->name, &(d->ia_prefix.prefix_addr) );
+
+	pr_info("KD6: Complete:\n");
+	kn->configured = true;
+	/* The other candidates become downstream ports */
+	hash_for_each(kn->dev_table, bkt, p, node)
+		if (p != d)
+			kd6_stop_xact(p);
+	kd6_setup_if(kn);
+	hash_for_each(kn->dev_table, bkt, p, node)
+		if (p != d && p->up)
+			kd6_ra_start(p);
+}
+
+/*
+ *  Move a device to a new state. Called with kn->lock held, from
+ *  the receive path as well as from process context, so the actual work
+ *  (sending, configuring) is always deferred to kd6_wq.
+ */
+static void kd6_enter_state(struct kd6_device *d, enum kd6_state state)
+{
+	struct kd6_net *kn = d->kn;
+	enum kd6_state old = d->state;
+
+	if (!kn->running)
+		return;
+
+	d->state = state;
+	hrtimer_try_to_cancel(&d->rtx_timer);
+
+	switch (state) {
+		case KD6_STATE_SOLICIT:
+			hrtimer_try_to_cancel(&d->lease_timer);
+			d->start_jiffies = jiffies;
+			kd6_new_xid(d);
+			/* fall through */
+		case KD6_STATE_REQUEST:
+			d->msg_jiffies = jiffies;
+			/* SOLICIT has no MRC, section 18.2.1 of RFC 8415 */
+			d->retries = state == KD6_STATE_SOLICIT ? -1 : KD6_SEND_RETRIES;
+			get_random_bytes(&d->timeout, sizeof(d->timeout));
+			d->timeout = KD6_BASE_TIMEOUT + (d->timeout % (unsigned int) KD6_TIMEOUT_RANDOM);
+			set_bit(KD6_DEV_XMIT, &d->flags);
+			queue_work(kd6_wq, &kn->xmit_work);
+			break;
+		case KD6_STATE_RENEW:
+		case KD6_STATE_REBIND:
+			d->start_jiffies = jiffies;
+			d->msg_jiffies = jiffies;
+			kd6_new_xid(d);
+			d->retries = -1;
+			d->timeout = KD6_REN_TIMEOUT;
+			/* RENEW until T2, REBIND until the lease runs out */
+			kd6_lease_arm(d, state == KD6_STATE_RENEW ?
+					d->t2 : d->valid);
+			set_bit(KD6_DEV_XMIT, &d->flags);
+			queue_work(kd6_wq, &kn->xmit_work);
+			break;
+		case KD6_STATE_BOUND:
+			hrtimer_try_to_cancel(&d->lease_timer);
+			kd6_lease_update(d);
+			kd6_lease_arm(d, d->t1);
+			/* Only the uplink's lease configures the box */
+			if (d == kn->uplink)
+				queue_work(kd6_wq, &kn->bound_work);
+			break;
+		default:
+			break;
+	}
+	trace_kd6_state(d->dev, kd6_xid_key(d->xid), old, state);
+}
+
+
+
+/*
+ *  Router Advertisement of a downstream port, section 4.2 of RFC 4861,
+ *  followed by its options: the /64 of the port, our link-layer address,
+ *  the MTU of the link and the DNS configuration of the lease.
+ */
+struct kd6_ra_mtu {
+	struct nd_opt_hdr hdr;
+	__be16 reserved;
+	__be32 mtu;
+};
+
+/*
+ *  Build the complete frame of the RA of a port, ready to be cloned.
+ *  Rebuilt when its prefix, the lease, or the addresses or the MTU of the
+ *  link change, see kd6_ra_gen.
+ */
+static struct sk_buff *kd6_ra_tmpl_build(struct kd6_device *d)
+{
+	struct net_device *dev = d->dev;
+	u32 preferred, valid, lifetime;
+	int hlen = LL_RESERVED_SPACE(dev);
+	int tlen = dev->needed_tailroom;
+	int slla = dev->addr_len ? ndisc_opt_addr_space(dev, NDISC_ROUTER_ADVERTISEMENT) : 0;
+	int dns = kd6_dns_ra_build(NULL, d->kn->dns, d->kn->dns_len, 0);
+	int len = sizeof(struct ra_msg) + sizeof(struct prefix_info) + slla +
+		sizeof(struct kd6_ra_mtu) + dns;
+	struct in6_addr saddr;
+	u8 ha[MAX_ADDR_LEN];
+	struct sk_buff *skb;
+	struct ipv6hdr *ipv6h;
+	struct ra_msg *ra;
+	struct prefix_info *pinfo;
+	struct kd6_ra_mtu *mtu;
+	u8 *opt;
+
+	/* Section 6.1.2 of RFC 4861: sourced from our link-local address */
+	if (ipv6_get_lladdr(dev, &saddr, IFA_F_TENTATIVE))
+		return NULL;
+	if (ndisc_mc_map(&in6addr_linklocal_allnodes, ha, dev, 1))
+		return NULL;
+
+	skb = alloc_skb(hlen + sizeof(struct ipv6hdr) + len + tlen, GFP_KERNEL);
+	if (!skb)
+		return NULL;
+	/* The router is default for no longer than its prefix lives */
+	kd6_lease_left(d->kn, &preferred, &valid);
+	lifetime = min_t(u32, KD6_RA_LIFETIME, valid);
+	skb_reserve(skb, hlen + sizeof(struct ipv6hdr));
+	skb->dev = dev;
+	skb->protocol = htons(ETH_P_IPV6);
+	skb->no_fcs = 1;
+
+	ra = skb_put_zero(skb, len);
+	ra->icmph.icmp6_type = NDISC_ROUTER_ADVERTISEMENT;
+	ra->icmph.icmp6_hop_limit = 64;
+	/* Medium, 3 is Reserved (section 2.2 of RFC 4191) */
+	ra->icmph.icmp6_router_pref = ICMPV6_ROUTER_PREF_MEDIUM;
+	ra->icmph.icmp6_rt_lifetime = htons(lifetime);
+
+	pinfo = (struct prefix_info *)(ra + 1);
+	pinfo->type = ND_OPT_PREFIX_INFO;
+	pinfo->length = sizeof(*pinfo) >> 3;
+	pinfo->prefix_len = 64;
+	pinfo->onlink = 1;
+	pinfo->autoconf = 1;
+	pinfo->valid = htonl(valid);
+	pinfo->prefered = htonl(preferred);
+	/* The port's /64, its address may still be tentative */
+	memcpy(&pinfo->prefix, &d->prefix, sizeof(pinfo->prefix) / 2);
+
+	opt = (u8 *)(pinfo + 1);
+	if (slla) {
+		opt[0] = ND_OPT_SOURCE_LL_ADDR;
+		opt[1] = slla >> 3;
+		memcpy(opt + 2, dev->dev_addr, dev->addr_len);
+		opt += slla;
+	}
+
+	mtu = (struct kd6_ra_mtu *)opt;
+	mtu->hdr.nd_opt_type = ND_OPT_MTU;
+	mtu->hdr.nd_opt_len = sizeof(*mtu) >> 3;
+	mtu->mtu = htonl(dev->mtu);
+	kd6_dns_ra_build((u8 *)(mtu + 1), d->kn->dns, d->kn->dns_len, lifetime);
+
+	ra->icmph.icmp6_cksum = csum_ipv6_magic(&saddr,
+			&in6addr_linklocal_allnodes, len, IPPROTO_ICMPV6,
+			csum_partial(ra, len, 0));
+
+	skb_push(skb, sizeof(struct ipv6hdr));
+	skb_reset_network_header(skb);
+	ipv6h = ipv6_hdr(skb);
+	ip6_flow_hdr(ipv6h, 0, 0);
+	ipv6h->payload_len = htons(len);
+	ipv6h->nexthdr = IPPROTO_ICMPV6;
+	ipv6h->hop_limit = 255;
+	ipv6h->saddr = saddr;
+	ipv6h->daddr = in6addr_linklocal_allnodes;
+
+	if (dev_hard_header(skb, dev, ETH_P_IPV6, ha, NULL, skb->len) < 0) {
+		kfree_skb(skb);
+		return NULL;
+	}
+	return skb;
+}
+
+static void kd6_ra_tmpl_free(struct kd6_device *d)
+{
+	kfree_skb(d->ra_tmpl);
+	d->ra_tmpl = NULL;
+}
+
+/*
+ *  Count the lifetimes of an RA down to what is left of the lease,
+ *  section 6.2.7 of RFC 4861, in a private copy of the template.
+ */
+static void kd6_ra_set_lifetimes(struct sk_buff *skb, u32 preferred, u32 valid)
+{
+	struct ra_msg *ra = (struct ra_msg *)(skb_network_header(skb) +
+			sizeof(struct ipv6hdr));
+	struct prefix_info *pinfo = (struct prefix_info *)(ra + 1);
+	u8 *opt = (u8 *)(pinfo + 1);
+	u8 *end = (u8 *)ra + ntohs(ipv6_hdr(skb)->payload_len);
+	__be16 rt = htons(min_t(u32, KD6_RA_LIFETIME, valid));
+	__be32 v = htonl(valid), p = htonl(preferred);
+	__be32 dns = htonl(min_t(u32, KD6_RA_LIFETIME, valid));
+	__be32 *lt;
+
+	csum_replace2(&ra->icmph.icmp6_cksum, ra->icmph.icmp6_rt_lifetime, rt);
+	ra->icmph.icmp6_rt_lifetime = rt;
+	csum_replace4(&ra->icmph.icmp6_cksum, pinfo->valid, v);
+	pinfo->valid = v;
+	csum_replace4(&ra->icmph.icmp6_cksum, pinfo->prefered, p);
+	pinfo->prefered = p;
+
+	/* RDNSS and DNSSL, after the SLLA and MTU options, like the router */
+	while (opt + 8 <= end && opt[1]) {
+		if (opt[0] == KD6_ND_OPT_RDNSS || opt[0] == KD6_ND_OPT_DNSSL) {
+			lt = (__be32 *)(opt + 4);
+			csum_replace4(&ra->icmph.icmp6_cksum, *lt, dns);
+			*lt = dns;
+		}
+		opt += opt[1] << 3;
+	}
+}
+
+static void kd6_nd_network_prefix_send(struct kd6_device *d){
+	struct sk_buff *skb = NULL;
+	unsigned int len;
+	int gen = atomic_read(&kd6_ra_gen);
+	u32 preferred, valid;
+	int err;
+
+	if (d->ra_tmpl && d->ra_gen != gen)
+		kd6_ra_tmpl_free(d);
+	if (!d->ra_tmpl) {
+		d->ra_tmpl = kd6_ra_tmpl_build(d);
+		d->ra_gen = gen;
+	}
+	/* Only an infinite lease leaves the template as it is */
+	kd6_lease_left(d->kn, &preferred, &valid);
+	if (d->ra_tmpl && preferred == KD6_INFINITY && valid == KD6_INFINITY) {
+		skb = skb_clone(d->ra_tmpl, GFP_KERNEL);
+	} else if (d->ra_tmpl) {
+		skb = skb_copy(d->ra_tmpl, GFP_KERNEL);
+		if (skb)
+			kd6_ra_set_lifetimes(skb, preferred, valid);
+	}
+	if (!skb) {
+		KD6_INC_STATS(KD6_STAT_TX_ERR);
+		return;
+	}
+	len = skb->len;
+	err = dev_queue_xmit(skb);
+	trace_kd6_ra_send(d->dev, len, err);
+	if (err < 0) {
+		pr_err("KD6: Error-dev_queue_xmit failed");
+		KD6_INC_STATS(KD6_STAT_TX_ERR);
+	} else
+		KD6_INC_STATS(KD6_STAT_TX_RA);
+	d->ra_last = ktime_get();
+}
+
+/*
+ *  RA timer of a downstream port, the RA itself is sent from kd6_wq.
+ */
+static enum hrtimer_restart kd6_ra_timer_fn(struct hrtimer *timer)
+{
+	struct kd6_device *d = container_of(timer, struct kd6_device, ra_timer);
+
+	queue_work(kd6_wq, &d->ra_work);
+	return HRTIMER_NORESTART;
+}
+
+/*
+ *  One work per port, so that sending an RA doesn't walk thousands of
+ *  them. kd6_wq being ordered, it never runs alongside a table change.
+ */
+static void kd6_ra_work_fn(struct work_struct *work)
+{
+	struct kd6_device *d = container_of(work, struct kd6_device, ra_work);
+	struct kd6_net *kn = d->kn;
+	unsigned int interval;
+
+	if (!kn->running || !kn->configured || d == kn->uplink || !d->up ||
+			!d->slot_len)
+		return;
+
+	kd6_nd_network_prefix_send(d);
+	/* A withdrawn prefix only answers Router Solicitations */
+	if (kn->withdrawn)
+		return;
+	/* Unsolicited: uniformly between Min and MaxRtrAdvInterval */
+	interval = KD6_RA_MIN_INTERVAL +
+		prandom_u32_max(KD6_RA_MAX_INTERVAL - KD6_RA_MIN_INTERVAL);
+	if (d->ra_burst > 0) {
+		d->ra_burst--;
+		interval = min(interval, (unsigned int)KD6_RA_BURST_INTERVAL);
+	}
+	hrtimer_start(&d->ra_timer, ms_to_ktime(interval), HRTIMER_MODE_REL);
+}
+
+/*
+ *  Start advertising on a port: the first RA goes out right away, then
+ *  a short burst so that hosts configure quickly.
+ */
+static void kd6_ra_start(struct kd6_device *d)
+{
+	d->ra_burst = KD6_RA_BURST - 1;
+	d->rs_tokens = KD6_RS_BURST;
+	d->rs_stamp = jiffies;
+	queue_work(kd6_wq, &d->ra_work);
+}
+
+static void kd6_ra_stop(struct kd6_device *d)
+{
+	hrtimer_cancel(&d->ra_timer);
+	/* Pending at most, kd6_wq is ordered and we run on it */
+	cancel_work_sync(&d->ra_work);
+	kd6_ra_tmpl_free(d);
+}
+
+/*
+ *  Bring the next RA forward to 'ms' from now, unless it is due sooner.
+ */
+static void kd6_ra_schedule(struct kd6_device *d, unsigned int ms)
+{
+	if (hrtimer_active(&d->ra_timer) &&
+			ktime_to_ms(hrtimer_get_remaining(&d->ra_timer)) <= ms)
+		return;
+	hrtimer_start(&d->ra_timer, ms_to_ktime(ms), HRTIMER_MODE_REL);
+}
+
+/*
+ *  Per port token bucket, so that an RS storm reschedules the port's RA
+ *  at most KD6_RS_RATE times a second. Checked once the port is looked
+ *  up, as the bucket is the port's.
+ */
+static bool kd6_rs_allow(struct kd6_device *d)
+{
+	unsigned long now = jiffies;
+	unsigned long add = (now - d->rs_stamp) * KD6_RS_RATE / HZ;
+
+	if (now - d->rs_stamp >= HZ * KD6_RS_BURST / KD6_RS_RATE) {
+		d->rs_tokens = KD6_RS_BURST;
+		d->rs_stamp = now;
+	} else if (add) {
+		d->rs_tokens = min_t(unsigned int, d->rs_tokens + add, KD6_RS_BURST);
+		d->rs_stamp += add * HZ / KD6_RS_RATE;
+	}
+	if (!d->rs_tokens)
+		return false;
+	d->rs_tokens--;
+	return true;
+}
+
+/*
+ *  Answer a Router Solicitation, section 6.2.6 of RFC 4861: the RA goes
+ *  out after a random delay of up to MAX_RA_DELAY_TIME, and never sooner
+ *  than MIN_DELAY_BETWEEN_RAS after the previous one.
+ */
+static void kd6_rs_rcv(struct kd6_net *kn, struct sk_buff *skb)
+{
+	struct kd6_device *d;
+	struct icmp6hdr _hdr, *hdr;
+	unsigned int delay;
+	s64 since;
+
+	hdr = skb_header_pointer(skb, 0, sizeof(_hdr), &_hdr);
+	if (!hdr || hdr->icmp6_type != NDISC_ROUTER_SOLICITATION ||
+			hdr->icmp6_code || ipv6_hdr(skb)->hop_limit != 255)
+		goto drop;
+
+	d = kd6_find_ifindex(kn, IP6CB(skb)->iif);
+	if (!d || d == kn->uplink || !d->up || !d->slot_len || !kn->configured)
+		return;
+	if (!kd6_rs_allow(d))
+		goto drop;
+
+	KD6_INC_STATS(KD6_STAT_RX_RS);
+	delay = prandom_u32_max(KD6_MAX_RA_DELAY_TIME);
+	since = ktime_ms_delta(ktime_get(), d->ra_last);
+	if (since + delay < KD6_MIN_DELAY_BETWEEN_RAS)
+		delay = KD6_MIN_DELAY_BETWEEN_RAS - since;
+	kd6_ra_schedule(d, delay);
+	return;
+
+drop:
+	KD6_INC_STATS(KD6_STAT_DROP_RS);
+}
+
+static void kd6_rs_work_fn(struct work_struct *work)
+{
+	struct kd6_net *kn = container_of(work, struct kd6_net, rs_work);
+	struct sk_buff *skb;
+	int err;
+
+	while ((skb = skb_recv_datagram(kn->rs_sock->sk, 0, 1, &err))) {
+		kd6_rs_rcv(kn, skb);
+		skb_free_datagram(kn->rs_sock->sk, skb);
+	}
+}
+
+static void kd6_rs_data_ready(struct sock *sk)
+{
+	struct kd6_net *kn = net_generic(sock_net(sk), kd6_net_id);
+
+	queue_work(kd6_wq, &kn->rs_work);
+}
+
+/*
+ *  Raw ICMPv6 socket that only lets Router Solicitations through. They
+ *  are read from kd6_wq, where the device list lives.
+ */
+static int kd6_rs_init(struct kd6_net *kn)
+{
+	struct icmp6_filter filter;
+	int err;
+
+	err = sock_create_kern(kn->net, AF_INET6, SOCK_RAW, IPPROTO_ICMPV6,
+			&kn->rs_sock);
+	if (err < 0)
+		return err;
+
+	/* A set bit blocks the type */
+	memset(&filter, 0xff, sizeof(filter));
+	filter.data[NDISC_ROUTER_SOLICITATION >> 5] &=
+		~(1U << (NDISC_ROUTER_SOLICITATION & 31));
+	err = kernel_setsockopt(kn->rs_sock, SOL_ICMPV6, ICMPV6_FILTER,
+			(char *)&filter, sizeof(filter));
+	if (err < 0) {
+		sock_release(kn->rs_sock);
+		kn->rs_sock = NULL;
+		return err;
+	}
+
+	write_lock_bh(&kn->rs_sock->sk->sk_callback_lock);
+	kn->rs_data_ready_orig = kn->rs_sock->sk->sk_data_ready;
+	kn->rs_sock->sk->sk_data_ready = kd6_rs_data_ready;
+	write_unlock_bh(&kn->rs_sock->sk->sk_callback_lock);
+	return 0;
+}
+
+static void kd6_rs_cleanup(struct kd6_net *kn)
+{
+	if (!kn->rs_sock)
+		return;
+	write_lock_bh(&kn->rs_sock->sk->sk_callback_lock);
+	kn->rs_sock->sk->sk_data_ready = kn->rs_data_ready_orig;
+	write_unlock_bh(&kn->rs_sock->sk->sk_callback_lock);
+	cancel_work_sync(&kn->rs_work);
+	sock_release(kn->rs_sock);
+	kn->rs_sock = NULL;
+}
+
+/*
+ *  Leave the groups of a downstream port. Called with rtnl held.
+ */
+static void kd6_mc_leave(struct kd6_device *d)
+{
+	if (d->ra_mc)
+		ipv6_dev_mc_dec(d->dev, &in6addr_linklocal_allrouters);
+	d->ra_mc = false;
+	if (d->relay_mc)
+		ipv6_dev_mc_dec(d->dev, &KD6_LINK_LOCAL_MULTICAST);
+	d->relay_mc = false;
+}
+
+/*
+ *  DHCPv6 relay agent, with the relay parameter. Messages of the clients
+ *  on the downstream ports go to the server in a Relay-Forward carrying
+ *  the port's ifindex as Interface-ID; the Relay-Reply is unwrapped and
+ *  sent back out of that port. Like Router Solicitations, everything is
+ *  read and sent from kd6_wq, where the device table lives.
+ */
+static int kd6_srv_send(struct kd6_net *kn, const void *buf, int len,
+		const struct in6_addr *daddr, u16 port, int ifindex)
+{
+	struct sockaddr_in6 sin6 = {
+		.sin6_family	= AF_INET6,
+		.sin6_port	= htons(port),
+		.sin6_addr	= *daddr,
+		.sin6_scope_id	= ifindex,
+	};
+	struct msghdr msg = {
+		.msg_name	= &sin6,
+		.msg_namelen	= sizeof(sin6),
+		.msg_flags	= MSG_DONTWAIT,
+	};
+	struct kvec iov = {
+		.iov_base	= (void *)buf,
+		.iov_len	= len,
+	};
+	int err;
+
+	err = kernel_sendmsg(kn->srv_sock, &msg, &iov, 1, len);
+	return err < 0 ? err : 0;
+}
+
+/*
+ *  A client, or a relay agent, on a downstream port: up to the server.
+ */
+static int kd6_relay_up(struct kd6_net *kn, struct kd6_device *d,
+		const u8 *data, int len, const struct in6_addr *peer)
+{
+	int ifindex = 0;
+	u8 *buf;
+	int err;
+
+	if (!d || d == kn->uplink || !d->up || !d->slot_len)
+		return -ENODEV;
+	/* Link-local servers are reached through the uplink */
+	if (__ipv6_addr_needs_scope_id(__ipv6_addr_type(&kd6_relay_server))) {
+		if (!kn->uplink)
+			return -ENETUNREACH;
+		ifindex = kn->uplink->ifindex;
+	}
+	/* So are multicast ones of wider scope, which ignore the scope id */
+	if (ipv6_addr_is_multicast(&kd6_relay_server)) {
+		int oif;
+
+		if (!kn->uplink)
+			return -ENETUNREACH;
+		oif = kn->uplink->ifindex;
+		err = kernel_setsockopt(kn->srv_sock, SOL_IPV6,
+				IPV6_MULTICAST_IF, (char *)&oif, sizeof(oif));
+		if (err)
+			return err;
+	}
+
+	buf = kmalloc(kd6_relay_forw_len(len), GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+	err = kd6_relay_forw_build(buf, data, len, &d->prefix, peer, d->ifindex);
+	if (err > 0)
+		err = kd6_srv_send(kn, buf, err, &kd6_relay_server,
+				KD6_SERVER_PORT, ifindex);
+	kfree(buf);
+	return err;
+}
+
+/*
+ *  A Relay-Reply from the server side: its message back to the port named
+ *  by the Interface-ID. A relay agent behind the port gets it still
+ *  wrapped, on the server port.
+ */
+static int kd6_relay_down(struct kd6_net *kn, struct kd6_device *from,
+		const u8 *data, int len)
+{
+	struct kd6_relay rr;
+	struct kd6_device *d;
+
+	/* Hosts on the downstream ports don't get to answer for the server */
+	if (from && from != kn->uplink)
+		return -EPERM;
+	if (kd6_relay_repl_parse(data, len, &rr))
+		return -EINVAL;
+	d = kd6_find_ifindex(kn, rr.ifindex);
+	if (!d || d == kn->uplink || !d->up)
+		return -ENODEV;
+	return kd6_srv_send(kn, rr.msg, rr.msg_len, &rr.peer,
+			rr.msg[0] == KD6_RELAY_REPL ? KD6_SERVER_PORT :
+			KD6_CLIENT_PORT, d->ifindex);
+}
+
+static int kd6_relay_rcv(struct kd6_net *kn, struct kd6_device *d,
+		const u8 *data, int len, const struct in6_addr *saddr)
+{
+	int err;
+
+	switch (data[0]) {
+		case KD6_SOLICIT:
+		case KD6_REQUEST:
+		case KD6_CONFIRM:
+		case KD6_RENEW:
+		case KD6_REBIND:
+		case KD6_RELEASE:
+		case KD6_DECLINE:
+		case KD6_INFORMATION_REQUEST:
+		case KD6_RELAY_FORW:
+			err = kd6_relay_up(kn, d, data, len, saddr);
+			if (!err)
+				KD6_INC_STATS(KD6_STAT_RELAY_FORW);
+			return err;
+		case KD6_RELAY_REPL:
+			err = kd6_relay_down(kn, d, data, len);
+			if (!err)
+				KD6_INC_STATS(KD6_STAT_RELAY_REPL);
+			return err;
+		default:
+			return -EOPNOTSUPP;
+	}
+}
+
+/*
+ *  Delegating server, with the delegate parameter. Requesting routers on
+ *  the downstream ports get a prefix of that length out of the uplink's
+ *  delegation, taken from the same slots as the subprefixes of the ports,
+ *  and a route to it through the address they asked from. Bindings are
+ *  kept by DUID and IAID; their expiry is a wheel of one second slots
+ *  turned by pds_work while there are any. Everything here runs under
+ *  rtnl.
+ */
+struct kd6_binding {
+	struct hlist_node node;		/* In kn->pds_bindings */
+	struct hlist_node wheel_node;	/* In kn->pds_wheel, unless infinite */
+	u32 key;
+	time64_t expires;		/* ktime_get_seconds() */
+	bool bound;			/* Requested, not only advertised */
+	bool routed;
+	u8 iaid[4];
+	u8 duid_len;
+	u8 duid[KD6_DUID_MAX_LEN];
+	int ifindex;			/* Port of the requesting router */
+	struct in6_addr gw;		/* and its address there */
+	unsigned int slot;		/* First /64 of the prefix */
+	struct in6_addr prefix;
+};
+
+#define KD6_PDS_WHEEL_MASK ((1 << KD6_PDS_WHEEL_BITS) - 1)
+
+static u32 kd6_pds_key(const struct kd6_reply *req)
+{
+	u32 iaid;
+
+	memcpy(&iaid, req->ia_pd.iaid, sizeof(iaid));
+	return jhash(req->client_id, req->client_id_len, iaid);
+}
+
+static struct kd6_binding *kd6_pds_find(struct kd6_net *kn,
+		const struct kd6_reply *req, u32 key)
+{
+	struct kd6_binding *b;
+
+	hash_for_each_possible(kn->pds_bindings, b, node, key)
+		if (b->key == key && b->duid_len == req->client_id_len &&
+				!memcmp(b->iaid, req->ia_pd.iaid, 4) &&
+				!memcmp(b->duid, req->client_id, b->duid_len))
+			return b;
+	return NULL;
+}
+
+/*
+ *  Route to the prefix of a binding, through the requesting router.
+ */
+static int kd6_pds_route(struct kd6_net *kn, struct kd6_binding *b, bool add)
+{
+	if (add)
+		return kd6_route_add(kn, &b->prefix, delegate, b->ifindex, &b->gw);
+	return kd6_route_del(kn, &b->prefix, delegate, b->ifindex, &b->gw);
+}
+
+/*
+ *  (Re)arm the expiry of a binding 'secs' from now.
+ */
+static void kd6_pds_arm(struct kd6_net *kn, struct kd6_binding *b, u32 secs)
+{
+	if (!hlist_unhashed(&b->wheel_node))
+		hlist_del_init(&b->wheel_node);
+	if (secs == KD6_INFINITY) {
+		b->expires = 0;
+		return;
+	}
+	b->expires = ktime_get_seconds() + max(secs, 1U);
+	hlist_add_head(&b->wheel_node,
+			&kn->pds_wheel[b->expires & KD6_PDS_WHEEL_MASK]);
+	queue_delayed_work(kd6_wq, &kn->pds_work, HZ);
+}
+
+/*
+ *  New binding, holding its prefix but not bound yet. The hash of the
+ *  DUID and IAID picks its preferred place, so a router tends to get the
+ *  same prefix back after a restart of either side.
+ */
+static struct kd6_binding *kd6_pds_alloc(struct kd6_net *kn,
+		struct kd6_device *d, const struct kd6_reply *req, u32 key)
+{
+	unsigned int n = 1U << (64 - delegate);
+	struct kd6_binding *b;
+	int slot;
+
+	if (!kn->slots || n > kn->nslots)
+		return NULL;
+	b = kzalloc(sizeof(*b), GFP_KERNEL);
+	if (!b)
+		return NULL;
+	slot = kd6_slots_take(kn, key & (kn->nslots - 1) & ~(n - 1), n);
+	if (slot < 0) {
+		kfree(b);
+		return NULL;
+	}
+
+	b->key = key;
+	memcpy(b->iaid, req->ia_pd.iaid, 4);
+	b->duid_len = req->client_id_len;
+	memcpy(b->duid, req->client_id, b->duid_len);
+	b->ifindex = d->ifindex;
+	b->slot = slot;
+	kd6_subprefix(kn->slots_base, slot, &b->prefix);
+	hash_add(kn->pds_bindings, &b->node, key);
+	if (!kn->pds_count++)
+		kn->pds_clock = ktime_get_seconds();
+	return b;
+}
+
+static void kd6_pds_free(struct kd6_net *kn, struct kd6_binding *b)
+{
+	if (b->routed)
+		kd6_pds_route(kn, b, false);
+	if (kn->slots)
+		bitmap_clear(kn->slots, b->slot, 1U << (64 - delegate));
+	hash_del(&b->node);
+	if (!hlist_unhashed(&b->wheel_node))
+		hlist_del(&b->wheel_node);
+	kfree(b);
+	kn->pds_count--;
+}
+
+/*
+ *  Drop the bindings of a port, or all of them for 0.
+ */
+static void kd6_pds_flush(struct kd6_net *kn, int ifindex)
+{
+	struct kd6_binding *b;
+	struct hlist_node *tmp;
+	int bkt;
+
+	hash_for_each_safe(kn->pds_bindings, bkt, tmp, b, node)
+		if (!ifindex || b->ifindex == ifindex)
+			kd6_pds_free(kn, b);
+}
+
+/*
+ *  Turn the wheel up to now. A slot holds the bindings of every round, so
+ *  only those that are due go.
+ */
+static void kd6_pds_work_fn(struct work_struct *work)
+{
+	struct kd6_net *kn = container_of(to_delayed_work(work),
+			struct kd6_net, pds_work);
+	time64_t now = ktime_get_seconds();
+	struct kd6_binding *b;
+	struct hlist_node *tmp;
+
+	rtnl_lock();
+	/* Late by more than a round: one round sees every slot */
+	if (now - kn->pds_clock > KD6_PDS_WHEEL_MASK + 1)
+		kn->pds_clock = now - KD6_PDS_WHEEL_MASK - 1;
+	while (kn->pds_clock < now) {
+		kn->pds_clock++;
+		hlist_for_each_entry_safe(b, tmp,
+				&kn->pds_wheel[kn->pds_clock & KD6_PDS_WHEEL_MASK],
+				wheel_node)
+			if (b->expires <= now) {
+				KD6_INC_STATS(KD6_STAT_PDS_EXPIRE);
+				kd6_pds_free(kn, b);
+			}
+	}
+	if (kn->pds_count)
+		queue_delayed_work(kd6_wq, &kn->pds_work, HZ);
+	rtnl_unlock();
+}
+
+/*
+ *  Lifetimes of a binding, and T1/T2 from them: it never outlives the
+ *  delegation it is carved from.
+ */
+static void kd6_pds_lifetimes(struct kd6_net *kn, struct kd6_pds_answer *a)
+{
+	kd6_lease_left(kn, &a->preferred, &a->valid);
+	a->t1 = a->preferred == KD6_INFINITY ? KD6_INFINITY : a->preferred / 2;
+	a->t2 = a->preferred == KD6_INFINITY ? KD6_INFINITY :
+		a->preferred / 5 * 4;
+}
+
+/*
+ *  A message of a requesting router on port 'd'. SOLICIT gets an
+ *  ADVERTISE holding a prefix for KD6_PDS_OFFER_TIME, or with Rapid
+ *  Commit a binding; REQUEST binds, RENEW and REBIND extend, RELEASE
+ *  frees. Called with rtnl held.
+ */
+static int kd6_pds_rcv(struct kd6_net *kn, struct kd6_device *d,
+		const u8 *data, int len, const struct in6_addr *saddr)
+{
+	struct kd6_pds_answer a = {
+		.msg_type	= KD6_REPLY,
+		.have_ia_pd	= true,
+		.dns		= kn->dns,
+		.dns_len	= kn->dns_len,
+	};
+	struct kd6_reply req;
+	struct kd6_binding *b;
+	u8 duid[8 + ETH_ALEN];
+	bool bind = false;
+	int duid_len;
+	u8 *buf;
+	u32 key;
+	int err;
+
+	if (!d || d == kn->uplink || !d->up || !d->slot_len || !kn->configured)
+		return -ENODEV;
+	if (kd6_parse_received(data + 4, len - 4, &req) ||
+			!req.client_id_len || !req.have_ia_pd)
+		return -EINVAL;
+
+	/* Our DUID is the client's, on the uplink */
+	duid_len = kd6_duid_fill(duid, kn->uplink->dev->dev_addr);
+	if (data[0] != KD6_SOLICIT && data[0] != KD6_REBIND &&
+			(req.server_id_len != duid_len ||
+			 memcmp(req.server_id, duid, duid_len)))
+		return -EINVAL;
+
+	key = kd6_pds_key(&req);
+	b = kd6_pds_find(kn, &req, key);
+	/* Moved to another port: its prefix is routed to the old one */
+	if (b && b->ifindex != d->ifindex) {
+		kd6_pds_free(kn, b);
+		b = NULL;
+	}
+
+	switch (data[0]) {
+		case KD6_SOLICIT:
+			a.rapid_commit = req.rapid_commit;
+			if (!a.rapid_commit)
+				a.msg_type = KD6_ADVERTISE;
+			bind = a.rapid_commit;
+			/* fall through */
+		case KD6_REQUEST:
+			if (data[0] == KD6_REQUEST)
+				bind = true;
+			if (!b)
+				b = kd6_pds_alloc(kn, d, &req, key);
+			if (!b) {
+				a.ia_status = KD6_STATUS_NOPREFIXAVAIL;
+				KD6_INC_STATS(KD6_STAT_PDS_NOPREFIX);
+			}
+			break;
+		case KD6_RENEW:
+		case KD6_REBIND:
+			if (b && b->bound)
+				bind = true;
+			else
+				a.ia_status = KD6_STATUS_NOBINDING;
+			break;
+		case KD6_RELEASE:
+			if (b)
+				kd6_pds_free(kn, b);
+			b = NULL;
+			a.msg_status = true;
+			a.have_ia_pd = false;
+			break;
+		default:
+			return -EOPNOTSUPP;
+	}
+
+	if (b) {
+		kd6_pds_lifetimes(kn, &a);
+		a.plen = delegate;
+		a.prefix = b->prefix;
+		if (!a.valid) {
+			kd6_pds_free(kn, b);
+			a.ia_status = KD6_STATUS_NOPREFIXAVAIL;
+		} else if (bind) {
+			if (!b->routed || !ipv6_addr_equal(&b->gw, saddr)) {
+				if (b->routed)
+					kd6_pds_route(kn, b, false);
+				b->gw = *saddr;
+				b->routed = !kd6_pds_route(kn, b, true);
+				if (!b->routed)
+					pr_warn("KD6: No route to %pI6c/%u via %pI6c\n",
+							&b->prefix, delegate, saddr);
+			}
+			b->bound = true;
+			kd6_pds_arm(kn, b, a.valid);
+			KD6_INC_STATS(KD6_STAT_PDS_BIND);
+		} else if (!b->bound) {
+			kd6_pds_arm(kn, b, KD6_PDS_OFFER_TIME);
+		}
+	}
+
+	buf = kmalloc(KD6_PDS_MSG_MAX, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+	err = kd6_pds_build(buf, data + 1, &req, duid, duid_len, &a);
+	err = kd6_srv_send(kn, buf, err, saddr, KD6_CLIENT_PORT, d->ifindex);
+	kfree(buf);
+	return err;
+}
+
+/*
+ *  INFORMATION-REQUEST of a host on port 'd', answered from the DNS
+ *  options of the lease, section 18.2.6 of RFC 8415.
+ */
+static int kd6_info_rcv(struct kd6_net *kn, struct kd6_device *d,
+		const u8 *data, int len, const struct in6_addr *saddr)
+{
+	struct kd6_pds_answer a = {
+		.msg_type	= KD6_REPLY,
+		.dns		= kn->dns,
+		.dns_len	= kn->dns_len,
+	};
+	struct kd6_reply req;
+	u8 duid[8 + ETH_ALEN];
+	int duid_len;
+	u8 *buf;
+	int err;
+
+	if (!d || d == kn->uplink || !d->up || !kn->configured ||
+			kn->withdrawn || !kn->dns_len)
+		return -ENODEV;
+	if (kd6_parse_received(data + 4, len - 4, &req))
+		return -EINVAL;
+	duid_len = kd6_duid_fill(duid, kn->uplink->dev->dev_addr);
+	if (req.server_id_len && (req.server_id_len != duid_len ||
+				memcmp(req.server_id, duid, duid_len)))
+		return -EINVAL;
+
+	buf = kmalloc(KD6_PDS_MSG_MAX, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+	err = kd6_pds_build(buf, data + 1, &req, duid, duid_len, &a);
+	err = kd6_srv_send(kn, buf, err, saddr, KD6_CLIENT_PORT, d->ifindex);
+	kfree(buf);
+	return err;
+}
+
+/*
+ *  A message on the server port: everything goes to the relay agent when
+ *  there is one, otherwise INFORMATION-REQUESTs are answered here and the
+ *  rest goes to the delegating server, if any.
+ */
+static void kd6_srv_rcv(struct kd6_net *kn, struct sk_buff *skb)
+{
+	enum kd6_stat drop = KD6_STAT_DROP_INFO;
+	const struct in6_addr *saddr;
+	struct kd6_device *d;
+	const u8 *data;
+	int len, err;
+
+	if (relay)
+		drop = KD6_STAT_DROP_RELAY;
+	else if (delegate)
+		drop = KD6_STAT_DROP_PDS;
+	if (udp_lib_checksum_complete(skb) || skb_linearize(skb))
+		goto drop;
+	data = skb->data + sizeof(struct udphdr);
+	len = skb->len - (int)sizeof(struct udphdr);
+	if (len < 4)
+		goto drop;
+
+	d = kd6_find_ifindex(kn, IP6CB(skb)->iif);
+	saddr = &ipv6_hdr(skb)->saddr;
+	if (relay) {
+		err = kd6_relay_rcv(kn, d, data, len, saddr);
+	} else if (data[0] == KD6_INFORMATION_REQUEST) {
+		drop = KD6_STAT_DROP_INFO;
+		err = kd6_info_rcv(kn, d, data, len, saddr);
+		if (!err)
+			KD6_INC_STATS(KD6_STAT_INFO_REPLY);
+	} else if (delegate) {
+		KD6_INC_STATS(KD6_STAT_PDS_RX);
+		rtnl_lock();
+		err = kd6_pds_rcv(kn, d, data, len, saddr);
+		rtnl_unlock();
+	} else {
+		err = -EOPNOTSUPP;
+	}
+	if (!err)
+		return;
+
+drop:
+	KD6_INC_STATS(drop);
+}
+
+static void kd6_srv_work_fn(struct work_struct *work)
+{
+	struct kd6_net *kn = container_of(work, struct kd6_net, srv_work);
+	struct sk_buff *skb;
+	int err;
+
+	while ((skb = skb_recv_udp(kn->srv_sock->sk, 0, 1, &err))) {
+		kd6_srv_rcv(kn, skb);
+		kfree_skb(skb);
+	}
+}
+
+static void kd6_srv_data_ready(struct sock *sk)
+{
+	struct kd6_net *kn = net_generic(sock_net(sk), kd6_net_id);
+
+	queue_work(kd6_wq, &kn->srv_work);
+}
+
+/*
+ *  UDP socket on the server port, read from kd6_wq.
+ */
+static int kd6_srv_init(struct kd6_net *kn)
+{
+	struct sockaddr_in6 sin6 = {
+		.sin6_family	= AF_INET6,
+		.sin6_port	= htons(KD6_SERVER_PORT),
+	};
+	int err;
+
+	err = sock_create_kern(kn->net, AF_INET6, SOCK_DGRAM, IPPROTO_UDP,
+			&kn->srv_sock);
+	if (err < 0)
+		return err;
+	err = kernel_bind(kn->srv_sock, (struct sockaddr *)&sin6, sizeof(sin6));
+	if (err < 0) {
+		pr_err("KD6: Failed to open UDP port %d, err %d\n",
+				KD6_SERVER_PORT, err);
+		sock_release(kn->srv_sock);
+		kn->srv_sock = NULL;
+		return err;
+	}
+
+	write_lock_bh(&kn->srv_sock->sk->sk_callback_lock);
+	kn->srv_data_ready_orig = kn->srv_sock->sk->sk_data_ready;
+	kn->srv_sock->sk->sk_data_ready = kd6_srv_data_ready;
+	write_unlock_bh(&kn->srv_sock->sk->sk_callback_lock);
+	return 0;
+}
+
+static void kd6_srv_cleanup(struct kd6_net *kn)
+{
+	if (!kn->srv_sock)
+		return;
+	write_lock_bh(&kn->srv_sock->sk->sk_callback_lock);
+	kn->srv_sock->sk->sk_data_ready = kn->srv_data_ready_orig;
+	write_unlock_bh(&kn->srv_sock->sk->sk_callback_lock);
+	cancel_work_sync(&kn->srv_work);
+	sock_release(kn->srv_sock);
+	kn->srv_sock = NULL;
+}
+
+
+
+/*
+ *  Device registry, kept in sync with the system by a netdevice notifier:
+ *  devices are picked up as they register and dropped as they go away,
+ *  and link changes start or stop their transaction or their RAs.
+ */
+
+/*
+ *  Device with this ifindex. From kd6_wq, like every user of dev_table.
+ */
+static struct kd6_device *kd6_find_ifindex(struct kd6_net *kn, int ifindex)
+{
+	struct kd6_device *d;
+
+	hash_for_each_possible(kn->dev_table, d, node, ifindex)
+		if (d->ifindex == ifindex)
+			return d;
+	return NULL;
+}
+
+static struct kd6_device *kd6_find_dev(struct kd6_net *kn, struct net_device *dev)
+{
+	struct kd6_device *d = kd6_find_ifindex(kn, dev->ifindex);
+
+	return d && d->dev == dev ? d : NULL;
+}
+
+/*
+ *  Start managing a device. Called with rtnl held.
+ */
+static struct kd6_device *kd6_add_dev(struct kd6_net *kn, struct net_device *dev)
+{
+	struct kd6_device *d;
+
+	if (dev->mtu < KD6_MIN_MTU) {
+		pr_warn("KD6: Ignoring device %s, MTU %d too small\n",
+				dev->name, dev->mtu);
+		return NULL;
+	}
+	if (!(dev->flags & IFF_UP) &&
+			dev_change_flags(dev, dev->flags | IFF_UP) < 0) {
+		pr_err("KD6: Failed to open %s\n", dev->name);
+		return NULL;
+	}
+	if (!(d = kzalloc(sizeof(struct kd6_device), GFP_KERNEL)))
+		return NULL;
+
+	dev_hold(dev);
+	d->kn = kn;
+	d->dev = dev;
+	d->ifindex = dev->ifindex;
+	/* xid is picked when the transaction starts */
+	d->state = KD6_STATE_IDLE;
+	hrtimer_init(&d->rtx_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	d->rtx_timer.function = kd6_rtx_timer_fn;
+	hrtimer_init(&d->lease_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	d->lease_timer.function = kd6_lease_timer_fn;
+	hrtimer_init(&d->ra_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	d->ra_timer.function = kd6_ra_timer_fn;
+	INIT_WORK(&d->ra_work, kd6_ra_work_fn);
+
+	hash_add(kn->dev_table, &d->node, d->ifindex);
+	pr_info("KD6: Device %s is suitable to send\n", dev->name);
+	return d;
+}
+
+/*
+ *  Once out of both tables, nothing but kd6_wq can reach the device.
+ */
+static void kd6_free_dev(struct kd6_device *d)
+{
+	dev_put(d->dev);
+	kfree(d);
+}
+
+/*
+ *  Stop managing a device. Called with rtnl held.
+ */
+static void kd6_del_dev(struct kd6_device *d)
+{
+	struct kd6_net *kn = d->kn;
+	struct kd6_device *p;
+	int bkt;
+
+	hash_del(&d->node);
+	kd6_stop_xact(d);
+	kd6_ra_stop(d);
+	kd6_mc_leave(d);
+	kd6_slot_free(d);
+	kd6_pds_flush(kn, d == kn->uplink ? 0 : d->ifindex);
+
+	if (d == kn->uplink) {
+		/* Lost the uplink: every port is a candidate again */
+		pr_warn("KD6: Uplink %s gone, soliciting again\n", d->dev->name);
+		spin_lock_bh(&kn->lock);
+		kn->uplink = NULL;
+		spin_unlock_bh(&kn->lock);
+		kn->configured = false;
+		kn->withdrawn = false;
+		kn->dns_len = 0;
+		kd6_aggr_del(kn);
+		hash_for_each(kn->dev_table, bkt, p, node) {
+			kd6_ra_stop(p);
+			kd6_mc_leave(p);
+			kd6_port_route_del(p);
+			/* Picked up again by kd6_link_change() */
+			p->up = false;
+		}
+	}
+	kd6_free_dev(d);
+}
+
+/*
+ *  The device went up or down, or gained or lost its carrier.
+ */
+static void kd6_link_change(struct kd6_device *d)
+{
+	struct kd6_net *kn = d->kn;
+	bool up = netif_running(d->dev) && netif_carrier_ok(d->dev);
+
+	if (up == d->up)
+		return;
+	d->up = up;
+
+	if (!kn->configured) {
+		/* Candidate uplink */
+		if (up) {
+			spin_lock_bh(&kn->lock);
+			kd6_enter_state(d, KD6_STATE_SOLICIT);
+			spin_unlock_bh(&kn->lock);
+		} else
+			kd6_stop_xact(d);
+	} else if (d != kn->uplink) {
+		/* Downstream port */
+		if (up && kn->slots) {
+			kd6_setup_dev(d);
+			kd6_ra_start(d);
+		} else
+			kd6_ra_stop(d);
+	}
+}
+
+/*
+ * Lease cache: the uplink's lease as a compact blob, read from and
+ * written to /sys/module/danir/lease. Saved at shutdown and written back
+ * after the module is loaded, it lets the uplink go straight to RENEW
+ * (or REBIND) while the downstream ports keep their prefixes.
+ */
+#define KD6_LEASE_MAGIC 0x4b44364c /* "KD6L" */
+#define KD6_LEASE_VERSION 2
+
+struct kd6_lease_blob {
+	__be32 magic;
+	u8 version;
+	u8 prefix_len;
+	u8 server_id_len;
+	u8 reserved;
+	char ifname[IFNAMSIZ];		/* Uplink */
+	u8 prefix[16];
+	u8 iaid[4];
+	__be32 t1, t2;			/* As granted, seconds */
+	__be32 preferred, valid;
+	__be64 granted;			/* Wall clock seconds */
+	u8 servaddr[16];
+	u8 servaddr_hw[6];
+	u8 server_id[KD6_DUID_MAX_LEN];	/* Server DUID */
+	__be16 dns_len;
+	u8 dns[KD6_DNS_MAX];		/* DNS options of the lease */
+}__attribute__((packed));
+
+/*
+ *  Snapshot the uplink's lease. Returns false when there is none.
+ */
+static bool kd6_lease_save(struct kd6_net *kn, struct kd6_lease_blob *b)
+{
+	struct kd6_device *d;
+	bool ret = false;
+
+	memset(b, 0, sizeof(*b));
+	spin_lock_bh(&kn->lock);
+	d = kn->uplink;
+	if (d && (d->state == KD6_STATE_BOUND || d->state == KD6_STATE_RENEW ||
+				d->state == KD6_STATE_REBIND)) {
+		b->magic = htonl(KD6_LEASE_MAGIC);
+		b->version = KD6_LEASE_VERSION;
+		b->prefix_len = d->ia_prefix.prefix_len;
+		strlcpy(b->ifname, d->dev->name, sizeof(b->ifname));
+		memcpy(b->prefix, d->ia_prefix.prefix_addr, sizeof(b->prefix));
+		memcpy(b->iaid, d->ia_pd.iaid, sizeof(b->iaid));
+		b->t1 = htonl(d->t1);
+		b->t2 = htonl(d->t2);
+		b->preferred = d->ia_prefix.prefered_lifetime;
+		b->valid = d->ia_prefix.valid_lifetime;
+		b->granted = cpu_to_be64(d->lease_real);
+		memcpy(b->servaddr, &d->servaddr, sizeof(b->servaddr));
+		memcpy(b->servaddr_hw, d->servaddr_hw, sizeof(b->servaddr_hw));
+		b->server_id_len = ntohs(d->server_id.option_len);
+		memcpy(b->server_id, d->server_id.duid, b->server_id_len);
+		b->dns_len = htons(d->dns_len);
+		memcpy(b->dns, d->dns, d->dns_len);
+		ret = true;
+	}
+	spin_unlock_bh(&kn->lock);
+	return ret;
+}
+
+/* What is left of a lifetime 'age' seconds later */
+static u32 kd6_lifetime_age(u32 secs, u32 age, u32 min)
+{
+	if (secs == KD6_INFINITY)
+		return secs;
+	return secs > age + min ? secs - age : min;
+}
+
+/*
+ *  Take the cached lease on the uplink and confirm it with the server
+ *  that granted it, or any server if T2 has already passed. The ports
+ *  are configured right away, DNS options included.
+ */
+static void kd6_lease_restore(struct kd6_device *d, const struct kd6_lease_blob *b)
+{
+	struct kd6_net *kn = d->kn;
+	struct kd6_reply r;
+	s64 age = ktime_get_real_seconds() - (s64)be64_to_cpu(b->granted);
+	u32 valid = ntohl(b->valid), t1, t2;
+
+	if (age < 0)
+		age = 0;
+	if (valid != KD6_INFINITY && age >= valid) {
+		pr_info("KD6: Cached lease on %pI6c/%u expired\n",
+				b->prefix, b->prefix_len);
+		return;
+	}
+
+	/* Walked like those of a reply, which leaves only the DNS ones */
+	if (kd6_parse_received(b->dns, ntohs(b->dns_len), &r)) {
+		pr_warn("KD6: Cached DNS options invalid\n");
+		r.dns_len = 0;
+	}
+	r.server_id_len = b->server_id_len;
+	memcpy(r.server_id, b->server_id, sizeof(r.server_id));
+	t1 = kd6_lifetime_age(ntohl(b->t1), age, 1);
+	t2 = kd6_lifetime_age(ntohl(b->t2), age, 1);
+
+	spin_lock_bh(&kn->lock);
+	if (kn->uplink && kn->uplink != d) {
+		spin_unlock_bh(&kn->lock);
+		return;
+	}
+	if (kd6_take_server(&d->server_id, &r)) {
+		spin_unlock_bh(&kn->lock);
+		pr_warn("KD6: Cached server DUID invalid\n");
+		return;
+	}
+	d->ia_pd.option_ia_pd = htons(KD6_OPT_IA_PD);
+	d->ia_pd.option_len = htons(12);
+	memcpy(d->ia_pd.iaid, b->iaid, sizeof(d->ia_pd.iaid));
+	t1 = htonl(t1);
+	t2 = htonl(t2);
+	memcpy(d->ia_pd.t1, &t1, sizeof(t1));
+	memcpy(d->ia_pd.t2, &t2, sizeof(t2));
+	d->ia_prefix.option_prefix = htons(KD6_OPT_IAPREFIX);
+	d->ia_prefix.option_len = htons(sizeof(d->ia_prefix) - 4);
+	d->ia_prefix.prefered_lifetime = htonl(kd6_lifetime_age(ntohl(b->preferred), age, 0));
+	d->ia_prefix.valid_lifetime = htonl(kd6_lifetime_age(valid, age, 1));
+	d->ia_prefix.prefix_len = b->prefix_len;
+	memcpy(d->ia_prefix.prefix_addr, b->prefix, sizeof(d->ia_prefix.prefix_addr));
+	memcpy(&d->servaddr, b->servaddr, sizeof(d->servaddr));
+	memcpy(d->servaddr_hw, b->servaddr_hw, sizeof(d->servaddr_hw));
+	d->dns_len = r.dns_len;
+	memcpy(d->dns, r.dns, r.dns_len);
+	kd6_lease_update(d);
+	kn->uplink = d;
+	/* Past T2 the RENEW times out into REBIND straight away */
+	kd6_enter_state(d, ipv6_addr_any(&d->servaddr) ?
+			KD6_STATE_REBIND : KD6_STATE_RENEW);
+	spin_unlock_bh(&kn->lock);
+
+	pr_info("KD6: Restored lease on %pI6c/%u on %s, %lld s old\n",
+			b->prefix, b->prefix_len, d->dev->name, age);
+	queue_work(kd6_wq, &kn->bound_work);
+}
+
+/*
+ *  Apply a written lease once its uplink is registered and running.
+ */
+static void kd6_lease_restore_pending(struct kd6_net *kn)
+{
+	struct kd6_lease_blob *b;
+	struct kd6_device *d = NULL;
+	int bkt;
+
+	spin_lock_bh(&kn->lock);
+	b = kn->lease_cache;
+	if (b && !kn->configured) {
+		hash_for_each(kn->dev_table, bkt, d, node)
+			if (d->up && !strncmp(d->dev->name, b->ifname, IFNAMSIZ))
+				break;
+		/* Keep it until its device shows up */
+		if (!d)
+			b = NULL;
+	}
+	if (b)
+		kn->lease_cache = NULL;
+	spin_unlock_bh(&kn->lock);
+
+	if (b && d)
+		kd6_lease_restore(d, b);
+	kfree(b);
+}
+
+/*
+ *  Forget every device. Called from kd6_wq, or once nothing can queue
+ *  work for the namespace any more.
+ */
+static void kd6_close_devs(struct kd6_net *kn)
+{
+	struct kd6_device *d;
+	struct hlist_node *tmp;
+	int bkt;
+
+	rtnl_lock();
+	hash_for_each_safe(kn->dev_table, bkt, tmp, d, node) {
+		hash_del(&d->node);
+		kd6_stop_xact(d);
+		kd6_ra_stop(d);
+		kd6_mc_leave(d);
+		kd6_port_route_del(d);
+		kd6_free_dev(d);
+	}
+	spin_lock_bh(&kn->lock);
+	kn->uplink = NULL;
+	spin_unlock_bh(&kn->lock);
+	kn->configured = false;
+	kn->withdrawn = false;
+	kn->dns_len = 0;
+	kd6_pds_flush(kn, 0);
+	kd6_aggr_del(kn);
+	bitmap_free(kn->slots);
+	kn->slots = NULL;
+	rtnl_unlock();
+}
+
+/*
+ *  Open the sockets of a namespace that got enabled. Called from kd6_wq.
+ */
+static int kd6_net_start(struct kd6_net *kn)
+{
+	int err;
+
+	err = kd6_dhcpv6PD_init(kn);
+	if (err)
+		return err;
+	/* Without it RAs are only unsolicited */
+	err = kd6_rs_init(kn);
+	if (err)
+		pr_warn("KD6: Router Solicitations ignored, error %d\n", err);
+	/* Serving INFORMATION-REQUESTs alone, it may be taken by a daemon */
+	err = kd6_srv_init(kn);
+	if (err && (relay || delegate)) {
+		kd6_rs_cleanup(kn);
+		kd6_dhcpv6PD_cleanup(kn);
+		return err;
+	} else if (err) {
+		pr_warn("KD6: INFORMATION-REQUESTs ignored, error %d\n", err);
+	}
+	if (kd6_emulating(kn)) {
+		err = kd6_emu_start(kn);
+		if (err) {
+			kd6_srv_cleanup(kn);
+			kd6_rs_cleanup(kn);
+			kd6_dhcpv6PD_cleanup(kn);
+			return err;
+		}
+	}
+
+	spin_lock_bh(&kn->lock);
+	kn->running = true;
+	spin_unlock_bh(&kn->lock);
+	return 0;
+}
+
+/*
+ *  Close the sockets and forget every device of a namespace. Called from
+ *  kd6_wq when it is disabled, or once the namespace is going away.
+ */
+static void kd6_net_stop(struct kd6_net *kn)
+{
+	spin_lock_bh(&kn->lock);
+	kn->running = false;
+	spin_unlock_bh(&kn->lock);
+
+	kd6_emu_stop(kn);
+	kd6_srv_cleanup(kn);
+	kd6_rs_cleanup(kn);
+	kd6_dhcpv6PD_cleanup(kn);
+	/* No receive handler left running on the devices */
+	synchronize_net();
+	kd6_close_devs(kn);
+	/* From kd6_wq they can only be pending */
+	cancel_delayed_work_sync(&kn->pds_work);
+	cancel_work_sync(&kn->xmit_work);
+	cancel_work_sync(&kn->lease_work);
+	cancel_work_sync(&kn->bound_work);
+}
+
+/*
+ *  Start or stop the namespace as net.danir.enable says, then bring its
+ *  registry in line with its devices.
+ */
+static void kd6_auto_config(struct work_struct *work)
+{
+	struct kd6_net *kn = container_of(work, struct kd6_net, config_work);
+	struct kd6_device *d;
+	struct hlist_node *tmp;
+	struct net_device *dev;
+	int bkt;
+
+	if (kn->dying)
+		return;
+	if (!READ_ONCE(kn->enable)) {
+		if (kn->running) {
+			pr_info("KD6: Disabled in namespace %u\n", kn->net->ns.inum);
+			kd6_net_stop(kn);
+		}
+		return;
+	}
+	if (!kn->running) {
+		if (kd6_net_start(kn))
+			return;
+		pr_info("KD6: Enabled in namespace %u\n", kn->net->ns.inum);
+	}
+	/* The emulated routers replace the registry */
+	if (kd6_emulating(kn)) {
+		if (kn->emu && !kd6_emu_devs_ok(kn->emu))
+			kd6_emu_stop(kn);
+		return;
+	}
+
+	rtnl_lock();
+	/* Forget devices that are going away or moved to another namespace */
+	hash_for_each_safe(kn->dev_table, bkt, tmp, d, node) {
+		if (d->dev->reg_state == NETREG_REGISTERED &&
+				net_eq(dev_net(d->dev), kn->net) &&
+				kd6_is_init_dev(d->dev))
+			continue;
+		pr_info("KD6: Device %s removed\n", d->dev->name);
+		kd6_del_dev(d);
+	}
+
+	/* Pick up new ones and follow the links of all */
+	for_each_netdev(kn->net, dev) {
+		if (!kd6_is_init_dev(dev))
+			continue;
+		d = kd6_find_dev(kn, dev);
+		if (!d && !(d = kd6_add_dev(kn, dev)))
+			continue;
+		kd6_link_change(d);
+	}
+	kd6_lease_restore_pending(kn);
+	rtnl_unlock();
+}
+
+static int kd6_netdev_event(struct notifier_block *this, unsigned long event,
+		void *ptr)
+{
+	struct net_device *dev = netdev_notifier_info_to_dev(ptr);
+	struct kd6_net *kn = net_generic(dev_net(dev), kd6_net_id);
+
+	/* Set under rtnl, which we are called with */
+	if (kn->dying)
+		return NOTIFY_DONE;
+
+	switch (event) {
+		case NETDEV_REGISTER:
+		case NETDEV_UNREGISTER:
+		case NETDEV_UP:
+		case NETDEV_DOWN:
+		case NETDEV_CHANGE:
+		case NETDEV_CHANGENAME:
+			queue_work(kd6_wq, &kn->config_work);
+			break;
+		case NETDEV_CHANGEADDR:
+			/* In the DUID and the Ethernet header of the messages */
+			atomic_inc(&kd6_tmpl_gen);
+			/* Fall through */
+		case NETDEV_CHANGEMTU:
+			/* Both are in the RA templates */
+			atomic_inc(&kd6_ra_gen);
+			break;
+		default:
+			break;
+	}
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block kd6_netdev_notifier = {
+	.notifier_call = kd6_netdev_event,
+};
+
+/*
+ *  RAs and DHCPv6 messages are sourced from the link-local address of the
+ *  device. One added while tentative only becomes usable after DAD, which
+ *  the messages built in the meantime are not kept for, see kd6_send_if.
+ */
+static int kd6_inet6addr_event(struct notifier_block *this,
+		unsigned long event, void *ptr)
+{
+	struct inet6_ifaddr *ifa = ptr;
+
+	if (ipv6_addr_type(&ifa->addr) & IPV6_ADDR_LINKLOCAL) {
+		atomic_inc(&kd6_ra_gen);
+		atomic_inc(&kd6_tmpl_gen);
+	}
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block kd6_inet6addr_notifier = {
+	.notifier_call = kd6_inet6addr_event,
+};
+
+/*
+ *  net.danir.enable: start or stop the client in the namespace.
+ */
+static int kd6_zero;
+static int kd6_one = 1;
+
+static int kd6_sysctl_enable(struct ctl_table *table, int write,
+		void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+	struct kd6_net *kn = container_of(table->data, struct kd6_net, enable);
+	int err;
+
+	err = proc_dointvec_minmax(table, write, buffer, lenp, ppos);
+	if (!err && write)
+		queue_work(kd6_wq, &kn->config_work);
+	return err;
+}
+
+static struct ctl_table kd6_sysctl_table[] = {
+	{
+		.procname	= "enable",
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= kd6_sysctl_enable,
+		.extra1		= &kd6_zero,
+		.extra2		= &kd6_one,
+	},
+	{ }
+};
+
+static int __net_init kd6_net_init(struct net *net)
+{
+	struct kd6_net *kn = net_generic(net, kd6_net_id);
+	struct ctl_table *table;
+
+	kn->net = net;
+	/* Only the initial namespace runs by default, as it always has */
+	kn->enable = net_eq(net, &init_net) && init_enable;
+	spin_lock_init(&kn->lock);
+	hash_init(kn->dev_table);
+	hash_init(kn->xid_table);
+	INIT_WORK(&kn->config_work, kd6_auto_config);
+	INIT_WORK(&kn->xmit_work, kd6_xmit_work_fn);
+	INIT_WORK(&kn->bound_work, kd6_bound_work_fn);
+	INIT_WORK(&kn->lease_work, kd6_lease_work_fn);
+	INIT_WORK(&kn->rs_work, kd6_rs_work_fn);
+	INIT_WORK(&kn->srv_work, kd6_srv_work_fn);
+	hash_init(kn->pds_bindings);
+	INIT_DELAYED_WORK(&kn->pds_work, kd6_pds_work_fn);
+
+	table = kmemdup(kd6_sysctl_table, sizeof(kd6_sysctl_table), GFP_KERNEL);
+	if (!table)
+		return -ENOMEM;
+	table[0].data = &kn->enable;
+	kn->sysctl = register_net_sysctl(net, "net/danir", table);
+	if (!kn->sysctl) {
+		kfree(table);
+		return -ENOMEM;
+	}
+	queue_work(kd6_wq, &kn->config_work);
+	return 0;
+}
+
+static void __net_exit kd6_net_exit(struct net *net)
+{
+	struct kd6_net *kn = net_generic(net, kd6_net_id);
+	struct ctl_table *table = kn->sysctl->ctl_table_arg;
+
+	unregister_net_sysctl_table(kn->sysctl);
+	kfree(table);
+	/* Keeps the notifier from queueing anything from here on */
+	rtnl_lock();
+	kn->dying = true;
+	rtnl_unlock();
+	cancel_work_sync(&kn->config_work);
+	kd6_net_stop(kn);
+	kfree(kn->lease_cache);
+}
+
+static struct pernet_operations kd6_net_ops = {
+	.init	= kd6_net_init,
+	.exit	= kd6_net_exit,
+	.id	= &kd6_net_id,
+	.size	= sizeof(struct kd6_net),
+};
+
+
+/*
+ *  debugfs kd6/stats: sum of the per-CPU counters, then the non-empty
+ *  histogram buckets as "<name> <upper bound in ms> <count>".
+ */
+static int kd6_stats_show(struct seq_file *seq, void *v)
+{
+	unsigned long sum;
+	int i, b, cpu;
+
+	for (i = 0; i < KD6_STAT_MAX; i++) {
+		sum = 0;
+		for_each_possible_cpu(cpu)
+			sum += per_cpu_ptr(kd6_stats, cpu)->cnt[i];
+		seq_printf(seq, "%s %lu\n", kd6_stat_names[i], sum);
+	}
+	for (i = 0; i < KD6_HIST_MAX; i++)
+		for (b = 0; b < KD6_HIST_BUCKETS; b++) {
+			sum = 0;
+			for_each_possible_cpu(cpu)
+				sum += per_cpu_ptr(kd6_stats, cpu)->hist[i][b];
+			if (sum)
+				seq_printf(seq, "%s %lu %lu\n", kd6_hist_names[i],
+						1UL << b, sum);
+		}
+	return 0;
+}
+
+static int kd6_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, kd6_stats_show, NULL);
+}
+
+static const struct file_operations kd6_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= kd6_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/*
+ *  debugfs kd6/emulate: progress of the emulated routers of the initial
+ *  namespace, and percentiles of the SOLICIT to REPLY latency in ms.
+ */
+static int kd6_emu_show(struct seq_file *seq, void *v)
+{
+	static const unsigned int pct[] = { 50, 90, 99 };
+	struct kd6_net *kn = net_generic(&init_net, kd6_net_id);
+	struct kd6_emu *e;
+	u64 n = 0, sum = 0, acc;
+	int i, p, max = 0;
+
+	/* kd6_emu_stop() unhooks it under kn->lock before freeing */
+	spin_lock_bh(&kn->lock);
+	e = kn->emu;
+	if (!e) {
+		spin_unlock_bh(&kn->lock);
+		seq_puts(seq, "off\n");
+		return 0;
+	}
+	spin_lock(&e->lock);
+	seq_printf(seq, "routers %u\n", e->ncpes);
+	seq_printf(seq, "solicit %llu\nrequest %llu\nretrans %llu\ntx_err %llu\n",
+			e->solicit, e->request, e->retrans, e->tx_err);
+	seq_printf(seq, "advertise %llu\nreply %llu\nnoprefix %llu\n",
+			e->advertise, e->reply, e->noprefix);
+	seq_printf(seq, "bound %llu\nfailed %llu\n", e->bound, e->failed);
+	seq_printf(seq, "solicit_rate %u\n", e->rate);
+	for (i = 0; i <= KD6_EMU_LAT_MAX; i++) {
+		n += e->latency[i];
+		sum += (u64)i * e->latency[i];
+		if (e->latency[i])
+			max = i;
+	}
+	if (n) {
+		seq_printf(seq, "latency_avg %llu\n", div64_u64(sum, n));
+		for (p = 0; p < ARRAY_SIZE(pct); p++) {
+			acc = 0;
+			for (i = 0; i < KD6_EMU_LAT_MAX; i++) {
+				acc += e->latency[i];
+				if (acc * 100 >= n * pct[p])
+					break;
+			}
+			seq_printf(seq, "latency_p%u %d\n", pct[p], i);
+		}
+		/* The last bucket holds anything slower */
+		seq_printf(seq, "latency_max %d%s\n", max,
+				max == KD6_EMU_LAT_MAX ? "+" : "");
+	}
+	spin_unlock(&e->lock);
+	spin_unlock_bh(&kn->lock);
+	return 0;
+}
+
+static int kd6_emu_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, kd6_emu_show, NULL);
+}
+
+static const struct file_operations kd6_emu_fops = {
+	.owner		= THIS_MODULE,
+	.open		= kd6_emu_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/*
+ *  The lease file serves the initial namespace.
+ */
+static ssize_t kd6_lease_read(struct file *filp, struct kobject *kobj,
+		struct bin_attribute *attr, char *buf, loff_t off, size_t count)
+{
+	struct kd6_net *kn = net_generic(&init_net, kd6_net_id);
+	struct kd6_lease_blob b;
+
+	if (!kd6_lease_save(kn, &b))
+		return 0;
+	return memory_read_from_buffer(buf, count, &off, &b, sizeof(b));
+}
+
+static ssize_t kd6_lease_write(struct file *filp, struct kobject *kobj,
+		struct bin_attribute *attr, char *buf, loff_t off, size_t count)
+{
+	struct kd6_net *kn = net_generic(&init_net, kd6_net_id);
+	struct kd6_lease_blob *b, *old;
+
+	if (off || count != sizeof(*b))
+		return -EINVAL;
+	b = (struct kd6_lease_blob *)buf;
+	if (b->magic != htonl(KD6_LEASE_MAGIC) ||
+			b->version != KD6_LEASE_VERSION ||
+			b->prefix_len > 64 ||
+			b->server_id_len > KD6_DUID_MAX_LEN ||
+			ntohs(b->dns_len) > KD6_DNS_MAX)
+		return -EINVAL;
+	b = kmemdup(buf, sizeof(*b), GFP_KERNEL);
+	if (!b)
+		return -ENOMEM;
+
+	spin_lock_bh(&kn->lock);
+	old = kn->lease_cache;
+	kn->lease_cache = b;
+	spin_unlock_bh(&kn->lock);
+	kfree(old);
+	queue_work(kd6_wq, &kn->config_work);
+	return count;
+}
+
+static struct bin_attribute kd6_lease_attr = {
+	.attr	= { .name = "lease", .mode = 0600 },
+	.size	= sizeof(struct kd6_lease_blob),
+	.read	= kd6_lease_read,
+	.write	= kd6_lease_write,
+};
+
+static int  KD6_LKM_init(void){
+	int err;
+
+	printk(KERN_INFO "KernelDhcpv6[KD6] DANIR LKM is started!\n" );
+	kd6_duid_set_time(utsname()->version);
+	if (relay && !in6_pton(relay, -1, kd6_relay_server.s6_addr, -1, NULL)) {
+		pr_err("KD6: Bad relay server address %s\n", relay);
+		return -EINVAL;
+	}
+	if (delegate && (relay || delegate > 64 ||
+				delegate < 64 - KD6_MAX_SLOTS_SHIFT)) {
+		pr_err("KD6: delegate must be a length of %d to 64, without relay\n",
+				64 - KD6_MAX_SLOTS_SHIFT);
+		return -EINVAL;
+	}
+	kd6_stats = alloc_percpu(struct kd6_stats);
+	if (!kd6_stats)
+		return -ENOMEM;
+	kd6_wq = alloc_ordered_workqueue("kd6", 0);
+	if (!kd6_wq) {
+		free_percpu(kd6_stats);
+		return -ENOMEM;
+	}
+
+	err = register_pernet_subsys(&kd6_net_ops);
+	if (err) {
+		destroy_workqueue(kd6_wq);
+		free_percpu(kd6_stats);
+		return err;
+	}
+	/* Statistics are best effort, never fail the load for them */
+	kd6_debugfs = debugfs_create_dir("kd6", NULL);
+	debugfs_create_file("stats", 0444, kd6_debugfs, NULL, &kd6_stats_fops);
+	debugfs_create_file("emulate", 0444, kd6_debugfs, NULL, &kd6_emu_fops);
+	err = sysfs_create_bin_file(&THIS_MODULE->mkobj.kobj, &kd6_lease_attr);
+	if (err)
+		pr_warn("KD6: No lease cache in sysfs, error %d\n", err);
+
+	pr_info ("KD6: Kernel DHCPv6 Lite initiated");
+	/*
+	 * Registering replays the existing devices. The exchange then runs in
+	 * the background, don't hold up the boot.
+	 */
+	register_inet6addr_notifier(&kd6_inet6addr_notifier);
+	err = register_netdevice_notifier(&kd6_netdev_notifier);
+	if (err) {
+		unregister_inet6addr_notifier(&kd6_inet6addr_notifier);
+		sysfs_remove_bin_file(&THIS_MODULE->mkobj.kobj, &kd6_lease_attr);
+		debugfs_remove_recursive(kd6_debugfs);
+		unregister_pernet_subsys(&kd6_net_ops);
+		destroy_workqueue(kd6_wq);
+		free_percpu(kd6_stats);
+		return err;
+	}
+	return 0;
+}
+
+static void __exit KD6_LKM_exit(void){
+	sysfs_remove_bin_file(&THIS_MODULE->mkobj.kobj, &kd6_lease_attr);
+	unregister_netdevice_notifier(&kd6_netdev_notifier);
+	unregister_inet6addr_notifier(&kd6_inet6addr_notifier);
+	/* Stops every namespace */
+	unregister_pernet_subsys(&kd6_net_ops);
+	destroy_workqueue(kd6_wq);
+	debugfs_remove_recursive(kd6_debugfs);
+	free_percpu(kd6_stats);
+	printk(KERN_INFO "Goodbye from KernelDhcpv6[KD6] DANIR LKM!\n");
+}
+
+module_init(KD6_LKM_init);
+module_exit(KD6_LKM_exit);
@@ -0,0 +1,185 @@
+/**
+ * @file    danir_trace.h
+ * @brief Tracepoints of the DANIR DHCPv6-PD client and RA sender.
+ *
+ * 	  perf list 'kd6:*' shows them, e.g.
+ * 	  perf record -e 'kd6:*' -a -- sleep 60
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM kd6
+
+#if !defined(_DANIR_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _DANIR_TRACE_H
+
+#include <linux/tracepoint.h>
+#include <linux/netdevice.h>
+#include <linux/in6.h>
+
+/* Message types of section 5.3 of RFC 3315 used by the client */
+#define show_kd6_msg_type(type)					\
+	__print_symbolic(type,					\
+			{ 1, "SOLICIT" },			\
+			{ 2, "ADVERTISE" },			\
+			{ 3, "REQUEST" },			\
+			{ 5, "RENEW" },				\
+			{ 6, "REBIND" },			\
+			{ 7, "REPLY" })
+
+/* enum kd6_state */
+#define show_kd6_state(state)					\
+	__print_symbolic(state,					\
+			{ 0, "IDLE" },				\
+			{ 1, "SOLICIT" },			\
+			{ 2, "REQUEST" },			\
+			{ 3, "BOUND" },				\
+			{ 4, "RENEW" },				\
+			{ 5, "REBIND" })
+
+DECLARE_EVENT_CLASS(kd6_msg,
+
+	TP_PROTO(const struct net_device *dev, u8 msg_type, u32 xid,
+		 unsigned int elapsed_ms),
+
+	TP_ARGS(dev, msg_type, xid, elapsed_ms),
+
+	TP_STRUCT__entry(
+		__string(	dev,		dev->name	)
+		__field(	u8,		msg_type	)
+		__field(	u32,		xid		)
+		__field(	unsigned int,	elapsed_ms	)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev->name);
+		__entry->msg_type = msg_type;
+		__entry->xid = xid;
+		__entry->elapsed_ms = elapsed_ms;
+	),
+
+	TP_printk("dev=%s type=%s xid=%06x elapsed=%ums",
+		  __get_str(dev), show_kd6_msg_type(__entry->msg_type),
+		  __entry->xid, __entry->elapsed_ms)
+);
+
+/* Elapsed since the start of the exchange */
+DEFINE_EVENT(kd6_msg, kd6_tx,
+	TP_PROTO(const struct net_device *dev, u8 msg_type, u32 xid,
+		 unsigned int elapsed_ms),
+	TP_ARGS(dev, msg_type, xid, elapsed_ms)
+);
+
+/* Elapsed since the first transmission of the message answered */
+DEFINE_EVENT(kd6_msg, kd6_rx,
+	TP_PROTO(const struct net_device *dev, u8 msg_type, u32 xid,
+		 unsigned int elapsed_ms),
+	TP_ARGS(dev, msg_type, xid, elapsed_ms)
+);
+
+TRACE_EVENT(kd6_state,
+
+	TP_PROTO(const struct net_device *dev, u32 xid, int old, int new),
+
+	TP_ARGS(dev, xid, old, new),
+
+	TP_STRUCT__entry(
+		__string(	dev,		dev->name	)
+		__field(	u32,		xid		)
+		__field(	int,		old		)
+		__field(	int,		new		)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev->name);
+		__entry->xid = xid;
+		__entry->old = old;
+		__entry->new = new;
+	),
+
+	TP_printk("dev=%s xid=%06x %s -> %s", __get_str(dev), __entry->xid,
+		  show_kd6_state(__entry->old), show_kd6_state(__entry->new))
+);
+
+TRACE_EVENT(kd6_prefix_assign,
+
+	TP_PROTO(const struct net_device *dev, const struct in6_addr *prefix,
+		 u8 prefix_len, u32 valid, u32 preferred),
+
+	TP_ARGS(dev, prefix, prefix_len, valid, preferred),
+
+	TP_STRUCT__entry(
+		__string(	dev,		dev->name	)
+		__array(	u8,		prefix,	16	)
+		__field(	u8,		prefix_len	)
+		__field(	u32,		valid		)
+		__field(	u32,		preferred	)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev->name);
+		memcpy(__entry->prefix, prefix, 16);
+		__entry->prefix_len = prefix_len;
+		__entry->valid = valid;
+		__entry->preferred = preferred;
+	),
+
+	TP_printk("dev=%s prefix=%pI6c/%u valid=%u preferred=%u",
+		  __get_str(dev), __entry->prefix, __entry->prefix_len,
+		  __entry->valid, __entry->preferred)
+);
+
+TRACE_EVENT(kd6_default_route,
+
+	TP_PROTO(const struct net_device *dev, const struct in6_addr *gw,
+		 u32 valid, int err),
+
+	TP_ARGS(dev, gw, valid, err),
+
+	TP_STRUCT__entry(
+		__string(	dev,		dev->name	)
+		__array(	u8,		gw,	16	)
+		__field(	u32,		valid		)
+		__field(	int,		err		)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev->name);
+		memcpy(__entry->gw, gw, 16);
+		__entry->valid = valid;
+		__entry->err = err;
+	),
+
+	TP_printk("dev=%s via %pI6c valid=%u err=%d", __get_str(dev),
+		  __entry->gw, __entry->valid, __entry->err)
+);
+
+TRACE_EVENT(kd6_ra_send,
+
+	TP_PROTO(const struct net_device *dev, unsigned int len, int err),
+
+	TP_ARGS(dev, len, err),
+
+	TP_STRUCT__entry(
+		__string(	dev,		dev->name	)
+		__field(	unsigned int,	len		)
+		__field(	int,		err		)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev->name);
+		__entry->len = len;
+		__entry->err = err;
+	),
+
+	TP_printk("dev=%s len=%u err=%d", __get_str(dev), __entry->len,
+		  __entry->err)
+);
+
+#endif /* _DANIR_TRACE_H */
+
+/* This part must be outside protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE danir_trace
+#include <trace/define_trace.h>
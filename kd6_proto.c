@@ -0,0 +1,677 @@
+/**
+ * @file    kd6_proto.c
+ * @author  Dmytro Shytyi
+ * @brief DHCPv6-PD messages of the DANIR client, see kd6_proto.h.
+ * 	  Built into the module and into user/libkd6.a.
+ */
+
+#ifdef __KERNEL__
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/errno.h>
+#include <linux/jhash.h>
+#include <linux/if_ether.h>
+#include <asm/unaligned.h>
+#include <asm/byteorder.h>
+#endif
+
+#include "kd6_proto.h"
+
+/*
+ * Option handlers get the option data, already checked to lie inside its
+ * container. Options without a handler, or outside their scope, are
+ * skipped.
+ */
+struct kd6_opt_handler {
+	int (*parse)(const u8 *p, u16 len, int scope, struct kd6_reply *r);
+	u16 min_len;
+	u8 scope;
+};
+
+static int kd6_walk_options(const u8 *p, int len, int scope,
+		struct kd6_reply *r);
+
+static int kd6_opt_server_id(const u8 *p, u16 len, int scope,
+		struct kd6_reply *r)
+{
+	if (len > KD6_DUID_MAX_LEN)
+		return -EINVAL;
+	r->server_id_len = len;
+	memcpy(r->server_id, p, len);
+	return 0;
+}
+
+static int kd6_opt_client_id(const u8 *p, u16 len, int scope,
+		struct kd6_reply *r)
+{
+	if (len > KD6_DUID_MAX_LEN)
+		return -EINVAL;
+	r->client_id_len = len;
+	memcpy(r->client_id, p, len);
+	return 0;
+}
+
+/*
+ *  DNS servers and domain list, kept whole as long as they fit, to be
+ *  handed downstream without being encoded again.
+ */
+static int kd6_opt_dns(const u8 *p, u16 len, int scope,
+		struct kd6_reply *r)
+{
+	const u8 *opt = p - 4;
+
+	if (get_unaligned_be16(opt) == KD6_OPT_DNS_SERVERS && len % 16)
+		return -EINVAL;
+	if (r->dns_len + 4 + len > KD6_DNS_MAX)
+		return 0;
+	memcpy(r->dns + r->dns_len, opt, 4 + len);
+	r->dns_len += 4 + len;
+	return 0;
+}
+
+static int kd6_opt_status(const u8 *p, u16 len, int scope,
+		struct kd6_reply *r)
+{
+	u16 code = get_unaligned_be16(p);
+
+	switch (scope) {
+		case KD6_SCOPE_MSG:
+			r->status = code;
+			break;
+		case KD6_SCOPE_IA_PD:
+			r->ia_status = code;
+			break;
+		default:
+			r->prefix_status = code;
+			break;
+	}
+	return 0;
+}
+
+static int kd6_opt_rapid_commit(const u8 *p, u16 len, int scope,
+		struct kd6_reply *r)
+{
+	r->rapid_commit = true;
+	return 0;
+}
+
+static int kd6_opt_ia_pd(const u8 *p, u16 len, int scope,
+		struct kd6_reply *r)
+{
+	const int fixed = 12; /* IAID, T1, T2 */
+
+	/* We only ever ask for one IA_PD */
+	if (r->have_ia_pd)
+		return 0;
+	r->have_ia_pd = true;
+	r->ia_pd.option_ia_pd = htons(KD6_OPT_IA_PD);
+	r->ia_pd.option_len = htons(fixed);
+	memcpy(r->ia_pd.iaid, p, 4);
+	memcpy(r->ia_pd.t1, p + 4, 4);
+	memcpy(r->ia_pd.t2, p + 8, 4);
+
+	return kd6_walk_options(p + fixed, len - fixed, KD6_SCOPE_IA_PD, r);
+}
+
+static int kd6_opt_iaprefix(const u8 *p, u16 len, int scope,
+		struct kd6_reply *r)
+{
+	struct dhcpv6_ia_prefix pfx;
+	const int fixed = sizeof(pfx) - 4; /* lifetimes, length, prefix */
+	int err;
+
+	memcpy(&pfx.prefered_lifetime, p, fixed);
+
+	r->prefix_status = KD6_STATUS_SUCCESS;
+	err = kd6_walk_options(p + fixed, len - fixed, KD6_SCOPE_IAPREFIX, r);
+	if (err)
+		return err;
+
+	/*
+	 * Keep the first prefix we can actually use: no error, still valid,
+	 * sane lifetimes (section 10 of RFC 3633) and room for a /64.
+	 */
+	if (r->have_prefix || r->prefix_status != KD6_STATUS_SUCCESS ||
+			!pfx.valid_lifetime || pfx.prefix_len > 64 ||
+			ntohl(pfx.prefered_lifetime) > ntohl(pfx.valid_lifetime))
+		return 0;
+	pfx.option_prefix = htons(KD6_OPT_IAPREFIX);
+	pfx.option_len = htons(fixed);
+	r->ia_prefix = pfx;
+	r->have_prefix = true;
+	return 0;
+}
+
+static const struct kd6_opt_handler kd6_opt_table[] = {
+	[KD6_OPT_CLIENTID]	= { kd6_opt_client_id, 1, KD6_SCOPE_MSG },
+	[KD6_OPT_SERVERID]	= { kd6_opt_server_id, 1, KD6_SCOPE_MSG },
+	[KD6_OPT_STATUS_CODE]	= { kd6_opt_status, 2, KD6_SCOPE_MSG |
+					KD6_SCOPE_IA_PD | KD6_SCOPE_IAPREFIX },
+	[KD6_OPT_RAPID_COMMIT]	= { kd6_opt_rapid_commit, 0, KD6_SCOPE_MSG },
+	[KD6_OPT_DNS_SERVERS]	= { kd6_opt_dns, 16, KD6_SCOPE_MSG },
+	[KD6_OPT_DOMAIN_LIST]	= { kd6_opt_dns, 1, KD6_SCOPE_MSG },
+	[KD6_OPT_IA_PD]		= { kd6_opt_ia_pd, 12, KD6_SCOPE_MSG },
+	[KD6_OPT_IAPREFIX]	= { kd6_opt_iaprefix, 25, KD6_SCOPE_IA_PD },
+};
+
+/*
+ *  Walk the 'len' bytes of options at p in place. Anything that does not
+ *  fit in its container is rejected; nesting is bounded by the scopes.
+ */
+static int kd6_walk_options(const u8 *p, int len, int scope,
+		struct kd6_reply *r)
+{
+	const struct kd6_opt_handler *h;
+	u16 code, olen;
+	int err;
+
+	while (len > 0) {
+		if (len < 4)
+			return -EINVAL;
+		code = get_unaligned_be16(p);
+		olen = get_unaligned_be16(p + 2);
+		p += 4;
+		len -= 4;
+		if (olen > len)
+			return -EINVAL;
+
+		pr_debug("KD6: option %d len %d", code, olen);
+		if (code < ARRAY_SIZE(kd6_opt_table)) {
+			h = &kd6_opt_table[code];
+			if (h->parse && (h->scope & scope)) {
+				if (olen < h->min_len)
+					return -EINVAL;
+				err = h->parse(p, olen, scope, r);
+				if (err)
+					return err;
+			}
+		}
+		p += olen;
+		len -= olen;
+	}
+	return 0;
+}
+
+/*
+ *  Parse the options of a received message, the 'len' bytes after its
+ *  type and transaction id.
+ */
+int kd6_parse_received(const u8 *opts, int len, struct kd6_reply *r)
+{
+	memset(r, 0, sizeof(*r));
+	return kd6_walk_options(opts, len, KD6_SCOPE_MSG, r);
+}
+
+/*
+ *  Remember the server of a reply, as the Server Identifier option
+ *  echoed back in REQUEST and RENEW. Any DUID type will do.
+ */
+int kd6_take_server(struct dhcpv6_server_id *sid, const struct kd6_reply *r)
+{
+	if (!r->server_id_len || r->server_id_len > sizeof(sid->duid))
+		return -EINVAL;
+	sid->option_server_id = htons(KD6_OPT_SERVERID);
+	sid->option_len = htons(r->server_id_len);
+	memcpy(sid->duid, r->server_id, r->server_id_len);
+	return 0;
+}
+
+/*
+ *  Length of the Relay-Forward of a 'len' bytes message.
+ */
+int kd6_relay_forw_len(int len)
+{
+	return sizeof(struct dhcpv6_relay_hdr) + 4 + len + 4 + 4;
+}
+
+/*
+ *  Wrap the 'len' bytes message from 'peer' into a Relay-Forward, in a
+ *  buffer of kd6_relay_forw_len() bytes. 'link' is an address on the
+ *  port's link, or :: when relaying another relay agent's message.
+ *  Returns the length, or an error when the hop limit is reached.
+ */
+int kd6_relay_forw_build(u8 *buf, const u8 *msg, int len,
+		const struct in6_addr *link, const struct in6_addr *peer,
+		u32 ifindex)
+{
+	struct dhcpv6_relay_hdr *rh = (void *)buf;
+	u8 *p = buf + sizeof(*rh);
+	__be32 id = htonl(ifindex);
+
+	rh->msg_type = KD6_RELAY_FORW;
+	rh->hop_count = 0;
+	memcpy(rh->link_addr, link, sizeof(rh->link_addr));
+	if (msg[0] == KD6_RELAY_FORW) {
+		if (len < sizeof(*rh) || msg[1] >= KD6_HOP_COUNT_LIMIT)
+			return -ELOOP;
+		rh->hop_count = msg[1] + 1;
+		memset(rh->link_addr, 0, sizeof(rh->link_addr));
+	}
+	memcpy(rh->peer_addr, peer, sizeof(rh->peer_addr));
+
+	*(__be16 *)p = htons(KD6_OPT_INTERFACE_ID);
+	*(__be16 *)(p + 2) = htons(sizeof(id));
+	memcpy(p + 4, &id, sizeof(id));
+	p += 4 + sizeof(id);
+
+	*(__be16 *)p = htons(KD6_OPT_RELAY_MSG);
+	*(__be16 *)(p + 2) = htons(len);
+	memcpy(p + 4, msg, len);
+	return p + 4 + len - buf;
+}
+
+/*
+ *  Find the peer, the Interface-ID and the Relay Message of a Relay-Reply.
+ *  The message is left in place, 'buf' must outlive its use.
+ */
+int kd6_relay_repl_parse(const u8 *buf, int len, struct kd6_relay *rr)
+{
+	const struct dhcpv6_relay_hdr *rh = (const void *)buf;
+	u16 code, olen;
+
+	memset(rr, 0, sizeof(*rr));
+	if (len < sizeof(*rh) || rh->msg_type != KD6_RELAY_REPL)
+		return -EINVAL;
+	memcpy(&rr->peer, rh->peer_addr, sizeof(rr->peer));
+	buf += sizeof(*rh);
+	len -= sizeof(*rh);
+
+	while (len > 0) {
+		if (len < 4)
+			return -EINVAL;
+		code = get_unaligned_be16(buf);
+		olen = get_unaligned_be16(buf + 2);
+		buf += 4;
+		len -= 4;
+		if (olen > len)
+			return -EINVAL;
+		switch (code) {
+			case KD6_OPT_RELAY_MSG:
+				rr->msg = buf;
+				rr->msg_len = olen;
+				break;
+			case KD6_OPT_INTERFACE_ID:
+				/* Only ours, other relays' go up with them */
+				if (olen == 4)
+					rr->ifindex = get_unaligned_be32(buf);
+				break;
+		}
+		buf += olen;
+		len -= olen;
+	}
+	return rr->msg && rr->msg_len ? 0 : -EINVAL;
+}
+
+static u8 *kd6_put_opt(u8 *p, u16 code, const void *data, u16 len)
+{
+	__be16 hdr[2] = { htons(code), htons(len) };
+
+	memcpy(p, hdr, sizeof(hdr));
+	if (len)
+		memcpy(p + sizeof(hdr), data, len);
+	return p + sizeof(hdr) + len;
+}
+
+/*
+ *  Answer 'req' from a requesting router, or a host: its client
+ *  identifier, our 'duid', then as 'a' says. 'buf' holds KD6_PDS_MSG_MAX
+ *  bytes. Returns the length.
+ */
+int kd6_pds_build(u8 *buf, const u8 *xid, const struct kd6_reply *req,
+		const u8 *duid, int duid_len, const struct kd6_pds_answer *a)
+{
+	u8 ia[12 + 4 + 25], *p = buf;
+	__be32 v;
+	__be16 status = htons(a->ia_status);
+	int ia_len = 12;
+
+	*p++ = a->msg_type;
+	memcpy(p, xid, 3);
+	p += 3;
+	/* INFORMATION-REQUEST may come without one */
+	if (req->client_id_len)
+		p = kd6_put_opt(p, KD6_OPT_CLIENTID, req->client_id,
+				req->client_id_len);
+	p = kd6_put_opt(p, KD6_OPT_SERVERID, duid, duid_len);
+	if (a->rapid_commit)
+		p = kd6_put_opt(p, KD6_OPT_RAPID_COMMIT, NULL, 0);
+	if (a->msg_status) {
+		__be16 success = htons(KD6_STATUS_SUCCESS);
+
+		p = kd6_put_opt(p, KD6_OPT_STATUS_CODE, &success, sizeof(success));
+	}
+	if (a->dns_len) {
+		memcpy(p, a->dns, a->dns_len);
+		p += a->dns_len;
+	}
+	if (!a->have_ia_pd)
+		return p - buf;
+
+	/* IAID, T1, T2, then the prefix or why there is none */
+	memcpy(ia, req->ia_pd.iaid, 4);
+	v = htonl(a->ia_status ? 0 : a->t1);
+	memcpy(ia + 4, &v, 4);
+	v = htonl(a->ia_status ? 0 : a->t2);
+	memcpy(ia + 8, &v, 4);
+	if (a->ia_status) {
+		kd6_put_opt(ia + ia_len, KD6_OPT_STATUS_CODE, &status,
+				sizeof(status));
+		ia_len += 4 + sizeof(status);
+	} else {
+		u8 pfx[25];
+
+		v = htonl(a->preferred);
+		memcpy(pfx, &v, 4);
+		v = htonl(a->valid);
+		memcpy(pfx + 4, &v, 4);
+		pfx[8] = a->plen;
+		memcpy(pfx + 9, &a->prefix, 16);
+		kd6_put_opt(ia + ia_len, KD6_OPT_IAPREFIX, pfx, sizeof(pfx));
+		ia_len += 4 + sizeof(pfx);
+	}
+	p = kd6_put_opt(p, KD6_OPT_IA_PD, ia, ia_len);
+	return p - buf;
+}
+
+/*
+ *  RDNSS and DNSSL options of an RA, from the DNS options of a lease: the
+ *  addresses and the encoded names are the same on both sides. Returns
+ *  their length; with a NULL 'buf', only the length.
+ */
+int kd6_dns_ra_build(u8 *buf, const u8 *dns, int len, u32 lifetime)
+{
+	__be32 lt = htonl(lifetime);
+	int olen, n = 0;
+	u16 code;
+
+	while (len >= 4) {
+		code = get_unaligned_be16(dns);
+		olen = get_unaligned_be16(dns + 2);
+		if (olen + 4 > len)
+			break;
+		if (olen) {
+			/* Type, length in units of 8 octets, reserved, lifetime */
+			int ra_len = 8 + ((olen + 7) & ~7);
+
+			if (buf) {
+				memset(buf + n, 0, ra_len);
+				buf[n] = code == KD6_OPT_DNS_SERVERS ?
+					KD6_ND_OPT_RDNSS : KD6_ND_OPT_DNSSL;
+				buf[n + 1] = ra_len >> 3;
+				memcpy(buf + n + 4, &lt, 4);
+				memcpy(buf + n + 8, dns + 4, olen);
+			}
+			n += ra_len;
+		}
+		dns += 4 + olen;
+		len -= 4 + olen;
+	}
+	return n;
+}
+
+int GetMon (const char *str){
+	const char * month_names[] = {
+		"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug",
+		"Sep", "Oct", "Nov", "Dec", NULL };
+	int i = 0;
+	while (i < 12) {
+		if (strcasecmp(month_names[i],str) == 0)
+			break;
+		++i;
+	}
+	if (i == 12) {
+		return 0;
+	} else {
+		return i + 1;
+	}
+}
+
+
+
+u32 convertTimeDateToSeconds(const struct tm date){
+	u32 y;
+	u32 m;
+	u32 d;
+	u32 t;
+
+	//Year
+	y = date.tm_year-2000;
+	//Month of year
+	m = date.tm_mon-1;
+	//Day of month
+	d = date.tm_mday-2;
+
+	//January and February are counted as months 13 and 14 of the previous year
+	if(m <= 2)
+	{
+		m += 12;
+		y -= 1;
+	}
+	//Convert years to days
+	t = (365 * y) + (y / 4) - (y / 100) + (y / 400);
+	//Convert months to days
+	t += (30 * m) + (3 * (m + 1) / 5) + d;
+	//Convert days to seconds
+	t *= 86400;
+	//Add hours, minutes and seconds
+	t += (3600 * (date.tm_hour-1)) + (60 * date.tm_min) + date.tm_sec;
+
+	//Return Unix time
+	return t;
+}
+
+/*
+ *  DUID-LLT time of our client identifier, derived from the kernel build
+ *  date in 'version' (utsname) so that it stays the same across reboots.
+ */
+__be32 kd6_duid_time;
+
+void kd6_duid_set_time(const char *version)
+{
+	struct tm dh6_ktime = {0};
+	char ktime_month[4];
+
+	sscanf(version, "%*s %*s %*s %*s %3s %d %d:%d:%d %*s %d",ktime_month, &dh6_ktime.tm_mday, &dh6_ktime.tm_hour, &dh6_ktime.tm_min, &dh6_ktime.tm_sec, &dh6_ktime.tm_year);
+	dh6_ktime.tm_mon=GetMon(ktime_month);
+	kd6_duid_time = htonl(convertTimeDateToSeconds(dh6_ktime));
+}
+
+/*
+ *  Our DUID-LLT with link-layer address 'hw', 14 bytes.
+ */
+int kd6_duid_fill(u8 *duid, const u8 *hw)
+{
+	__be16 type = htons(1), hw_type = htons(1);
+
+	memcpy(duid, &type, 2);
+	memcpy(duid + 2, &hw_type, 2);
+	memcpy(duid + 4, &kd6_duid_time, 4);
+	memcpy(duid + 8, hw, ETH_ALEN);
+	return 8 + ETH_ALEN;
+}
+
+static void kd6_fill_client_id(const u8 *hw, struct dhcpv6_client_id *cid)
+{
+	cid->option_client_id = htons(KD6_OPT_CLIENTID);
+	cid->option_len = htons(14);
+	cid->duid_type = htons(1);
+	cid->hw_type = htons(1);
+	memcpy(&cid->duid_time, &kd6_duid_time, sizeof(kd6_duid_time));
+	memcpy(cid->my_hw_addr, hw, ETH_ALEN);
+}
+
+static void kd6_fill_oro(struct dhcpv6_oro *oro)
+{
+	u8  val_time[4] = {0x00,0x17,0x00,0x18};
+
+	oro->option = htons(KD6_OPT_ORO);
+	oro->option_len = htons(4);
+	memcpy(oro->value,val_time,sizeof(val_time));
+}
+
+static void kd6_fill_ia_pd(const u8 *hw, struct dhcpv6_ia_pd *ia_pd, u16 len)
+{
+	u8 t1[4]={0x00,0x00,0x0e,0x10};
+	u8 t2[4]={0x00,0x00,0x15,0x18};
+
+	ia_pd->option_ia_pd = htons(KD6_OPT_IA_PD);
+	ia_pd->option_len = htons(len);
+	ia_pd->iaid[1]=hw[3];
+	ia_pd->iaid[2]=hw[4];
+	ia_pd->iaid[3]=hw[5];
+	memcpy(ia_pd->t1,t1,sizeof(t1));
+	memcpy(ia_pd->t2,t2,sizeof(t2));
+}
+
+/* REQUEST and RENEW up to the Server ID, without the struct's tail padding */
+#define KD6_REQ_LEN (offsetof(struct dhcpv6_packet_req, ia_prefix) + \
+		sizeof(struct dhcpv6_ia_prefix))
+
+/*
+ *  Fill in a DHCPv6 message of the client with link-layer address 'hw',
+ *  which gives its DUID and IAID, into a zeroed buffer of kd6_msg_len()
+ *  bytes. Elapsed Time is left at zero, kd6_send_if() patches it on every
+ *  transmission. Returns the offset of its value within the message.
+ */
+int kd6_options_send_if(u8 msg_type,struct dhcpv6_packet dhp, const u8 *hw,
+		const struct dhcpv6_server_id *server_id,
+		const struct dhcpv6_ia_prefix *ia_prefix, const u8 *xid,
+		bool rapid_commit){
+	struct dhcpv6_time *time;
+
+	switch (msg_type){
+		case KD6_SOLICIT:
+			dhp.kd6_sol->msg_type = KD6_SOLICIT;
+			memcpy(dhp.kd6_sol->transaction_id,xid,3);
+			kd6_fill_client_id(hw, &dhp.kd6_sol->my_client_id);
+			kd6_fill_oro(&dhp.kd6_sol->oro);
+			time = &dhp.kd6_sol->time;
+			kd6_fill_ia_pd(hw, &dhp.kd6_sol->ia_pd, 0x0c);
+			//rapid commit option, right after the fixed layout
+			if (rapid_commit) {
+				struct dhcpv6_rapid_commit *rc = (void *)(dhp.kd6_sol + 1);
+
+				rc->option = htons(KD6_OPT_RAPID_COMMIT);
+				rc->option_len = 0;
+			}
+			break;
+		case KD6_REQUEST:
+		case KD6_RENEW:
+			dhp.kd6_req->msg_type = msg_type;
+			memcpy(dhp.kd6_req->transaction_id,xid,3);
+			kd6_fill_client_id(hw, &dhp.kd6_req->my_client_id);
+			kd6_fill_oro(&dhp.kd6_req->oro);
+			time = &dhp.kd6_req->time;
+			//ia pd option, carries the ia pd prefix
+			kd6_fill_ia_pd(hw, &dhp.kd6_req->ia_pd,
+					0x0c + sizeof(struct dhcpv6_ia_prefix));
+			memcpy (&(dhp.kd6_req->ia_prefix),ia_prefix ,sizeof(dhp.kd6_req->ia_prefix));
+			//server id option, last as its DUID is variable length
+			memcpy((u8 *)dhp.kd6_req + KD6_REQ_LEN, server_id,
+					4 + ntohs(server_id->option_len));
+			break;
+		default:
+			dhp.kd6_reb->msg_type = KD6_REBIND;
+			memcpy(dhp.kd6_reb->transaction_id,xid,3);
+			kd6_fill_client_id(hw, &dhp.kd6_reb->my_client_id);
+			//no server id: any server may extend the lease
+			kd6_fill_oro(&dhp.kd6_reb->oro);
+			time = &dhp.kd6_reb->time;
+			//ia pd option, carries the ia pd prefix
+			kd6_fill_ia_pd(hw, &dhp.kd6_reb->ia_pd,
+					0x0c + sizeof(struct dhcpv6_ia_prefix));
+			memcpy (&(dhp.kd6_reb->ia_prefix),ia_prefix ,sizeof(dhp.kd6_reb->ia_prefix));
+			break;
+	}
+
+	//time option
+	time->option_time = htons(KD6_OPT_ELAPSED_TIME);
+	time->option_len = htons(2);
+	time->value = 0;
+	return (u8 *)&time->value - (u8 *)dhp.kd6_sol;
+}
+
+/*
+ *  Length of a message we send, or 0 for one we don't. REQUEST and
+ *  RENEW carry 'server_id' with its DUID.
+ */
+int kd6_msg_len(u8 msg_type, bool rapid_commit,
+		const struct dhcpv6_server_id *server_id)
+{
+	switch (msg_type) {
+		case KD6_SOLICIT:
+			if (rapid_commit)
+				return sizeof(struct dhcpv6_packet_sol) +
+					sizeof(struct dhcpv6_rapid_commit);
+			return sizeof(struct dhcpv6_packet_sol);
+		case KD6_REQUEST:
+		case KD6_RENEW:
+			return KD6_REQ_LEN + 4 + ntohs(server_id->option_len);
+		case KD6_REBIND:
+			return sizeof(struct dhcpv6_packet_reb);
+		default:
+			return 0;
+	}
+}
+
+/*
+ *  Subprefixes: the delegated prefix is cut in /64 slots, the first 64
+ *  bits of an address in host order. kd6_prefix_base() masks the
+ *  delegation down to its length.
+ */
+u64 kd6_prefix_base(const u8 *prefix_addr, u8 plen)
+{
+	u64 base;
+
+	memcpy(&base, prefix_addr, sizeof(base));
+	base = be64_to_cpu(base);
+	if (!plen)
+		base = 0;
+	else if (plen < 64)
+		base &= ~((1ULL << (64 - plen)) - 1);
+	return base;
+}
+
+/*
+ *  Prefix length configured for a port in 'port_size', e.g.
+ *  "eth2=60,eth3=60"; 64 if none.
+ */
+u8 kd6_port_len(const char *port_size, const char *name)
+{
+	const char *p = port_size;
+	size_t n = strlen(name);
+	unsigned int len;
+
+	while (p && *p) {
+		if (!strncmp(p, name, n) && p[n] == '=' &&
+				sscanf(p + n + 1, "%u", &len) == 1 &&
+				len >= 64 - KD6_MAX_SLOTS_SHIFT && len <= 64)
+			return len;
+		p = strchr(p, ',');
+		if (p)
+			p++;
+	}
+	return 64;
+}
+
+/*
+ *  Preferred first slot of a port taking 'n' aligned slots out of
+ *  'nslots', both powers of two: a hash of its name, so that it keeps its
+ *  subprefix across restarts.
+ */
+unsigned int kd6_slot_pref(const char *name, unsigned int nslots,
+		unsigned int n)
+{
+	return jhash(name, strlen(name), 0) & (nslots - 1) & ~(n - 1);
+}
+
+/*
+ *  The /64 of a slot.
+ */
+void kd6_subprefix(u64 base, unsigned int slot, struct in6_addr *prefix)
+{
+	__be64 sub = cpu_to_be64(base | slot);
+
+	memset(prefix, 0, sizeof(*prefix));
+	memcpy(prefix, &sub, sizeof(sub));
+}
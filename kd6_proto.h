@@ -0,0 +1,278 @@
+/**
+ * @file    kd6_proto.h
+ * @brief DHCPv6-PD messages of the DANIR client: wire format, option
+ * 	  parsing and building, DUID and subprefix arithmetic.
+ *
+ * 	  Nothing here touches sockets, skbs or devices, so kd6_proto.c
+ * 	  builds both into the module and, with user/kd6_user.h, into a
+ * 	  userspace library (see user/Makefile).
+ */
+
+#ifndef _KD6_PROTO_H
+#define _KD6_PROTO_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/time.h>
+#include <linux/in6.h>
+#else
+#include "kd6_user.h"
+#endif
+
+
+
+
+/* 
+ * DHCPv6 message types, defined in section 5.3 of RFC 3315 
+ */
+#define KD6_SOLICIT              1
+#define KD6_ADVERTISE            2
+#define KD6_REQUEST              3
+#define KD6_CONFIRM              4
+#define KD6_RENEW                5
+#define KD6_REBIND               6
+#define KD6_REPLY                7
+#define KD6_RELEASE              8
+#define KD6_DECLINE              9
+#define KD6_RECONFIGURE         10
+#define KD6_INFORMATION_REQUEST 11
+#define KD6_RELAY_FORW          12
+#define KD6_RELAY_REPL          13
+#define KD6_LEASEQUERY          14   /* RFC5007 */
+#define KD6_LEASEQUERY_REPLY    15   /* RFC5007 */
+#define KD6_LEASEQUERY_DONE     16   /* RFC5460 */
+#define KD6_LEASEQUERY_DATA     17   /* RFC5460 */
+#define KD6_RECONFIGURE_REQUEST 18   /* RFC6977 */
+#define KD6_RECONFIGURE_REPLY   19   /* RFC6977 */
+#define KD6_DHCPV4_QUERY        20   /* RFC7341 */
+#define KD6_DHCPV4_RESPONSE     21   /* RFC7341 */
+
+/*
+ * DHCPv6 options, section 22 of RFC 3315 and section 10 of RFC 3633
+ */
+#define KD6_OPT_CLIENTID         1
+#define KD6_OPT_SERVERID         2
+#define KD6_OPT_ORO              6
+#define KD6_OPT_ELAPSED_TIME     8
+#define KD6_OPT_RELAY_MSG        9
+#define KD6_OPT_STATUS_CODE     13
+#define KD6_OPT_RAPID_COMMIT    14
+#define KD6_OPT_INTERFACE_ID    18
+#define KD6_OPT_DNS_SERVERS     23   /* RFC3646 */
+#define KD6_OPT_DOMAIN_LIST     24   /* RFC3646 */
+#define KD6_OPT_IA_PD           25   /* RFC3633 */
+#define KD6_OPT_IAPREFIX        26   /* RFC3633 */
+
+/*
+ * Status codes, section 24.4 of RFC 3315 and section 16 of RFC 3633
+ */
+#define KD6_STATUS_SUCCESS       0
+#define KD6_STATUS_NOBINDING     3
+#define KD6_STATUS_NOPREFIXAVAIL 6
+
+#define KD6_DUID_MAX_LEN       130   /* Type code + up to 128 octets */
+#define KD6_HOP_COUNT_LIMIT      8   /* Relay agents in a row, RFC 8415 */
+#define KD6_DNS_MAX            256   /* Options 23 and 24 kept, with headers */
+
+/*
+ * DNS options of Router Advertisements, RFC 8106
+ */
+#define KD6_ND_OPT_RDNSS        25
+#define KD6_ND_OPT_DNSSL        31
+
+
+
+/* Any DUID type: only the first option_len bytes of duid are sent */
+struct dhcpv6_server_id{
+	u16 option_server_id;
+	u16 option_len;
+	u8 duid[KD6_DUID_MAX_LEN];
+}__attribute__((packed));
+
+
+
+struct dhcpv6_client_id{
+	u16 option_client_id;
+	u16 option_len;
+	u16 duid_type;
+	u16 hw_type;
+	u32 duid_time;
+	u8 my_hw_addr[6];
+}__attribute__((packed));
+
+
+struct dhcpv6_time{
+	u16 option_time;
+	u16 option_len;
+	u16 value;
+};
+
+struct dhcpv6_oro{
+	u16 option;
+	u16 option_len;
+	u8 value[4];
+};
+
+struct dhcpv6_ia_prefix{
+	u16 option_prefix;
+	u16 option_len;
+	u32 prefered_lifetime;
+	u32 valid_lifetime;
+	u8 prefix_len;
+	u8 prefix_addr[16];
+
+}__attribute__((packed));
+
+
+struct dhcpv6_ia_pd{
+	u16 option_ia_pd;
+	u16 option_len;
+	u8 iaid[4];
+	u8 t1[4];
+	u8 t2[4];
+	//	struct dhcpv6_ia_prefix ia_prefix
+};
+
+struct dhcpv6_rapid_commit{
+	u16 option;
+	u16 option_len;
+};
+
+struct dhcpv6_packet_sol {
+	u8 msg_type;
+	u8 transaction_id[3];
+	struct dhcpv6_client_id my_client_id;
+	struct dhcpv6_oro oro;
+	struct dhcpv6_time time;
+	struct dhcpv6_ia_pd ia_pd;        
+};
+struct dhcpv6_packet_req {
+	u8 msg_type;
+	u8 transaction_id[3];
+	struct dhcpv6_client_id my_client_id;
+	struct dhcpv6_oro oro;
+	struct dhcpv6_time time;
+	struct dhcpv6_ia_pd ia_pd;
+	struct dhcpv6_ia_prefix ia_prefix;
+	//	struct dhcpv6_server_id my_server_id, of its own length
+};
+struct dhcpv6_packet_reb {
+	u8 msg_type;
+	u8 transaction_id[3];
+	struct dhcpv6_client_id my_client_id;
+	struct dhcpv6_oro oro;
+	struct dhcpv6_time time;
+	struct dhcpv6_ia_pd ia_pd;
+	struct dhcpv6_ia_prefix ia_prefix;
+};
+
+struct dhcpv6_packet{
+	struct dhcpv6_packet_sol *kd6_sol;
+	struct dhcpv6_packet_req *kd6_req;
+	struct dhcpv6_packet_reb *kd6_reb;
+};
+
+
+/*
+ * What a received message says. Filled in by kd6_parse_received() on the
+ * stack of the receive path, nothing is allocated per packet.
+ */
+struct kd6_reply {
+	u16 status;			/* Message level status code */
+	u16 ia_status;			/* IA_PD level status code */
+	u16 prefix_status;		/* Status of the IAPREFIX being parsed */
+	bool have_ia_pd;
+	bool have_prefix;
+	bool rapid_commit;		/* Server committed the binding */
+	u8 server_id_len;
+	u8 server_id[KD6_DUID_MAX_LEN];	/* Server DUID, without option header */
+	u8 client_id_len;		/* Same, of a client message */
+	u8 client_id[KD6_DUID_MAX_LEN];
+	struct dhcpv6_ia_pd ia_pd;	/* First IA_PD */
+	struct dhcpv6_ia_prefix ia_prefix; /* First usable prefix in it */
+	u16 dns_len;
+	u8 dns[KD6_DNS_MAX];		/* DNS options, as received */
+};
+
+/* Where an option may appear */
+#define KD6_SCOPE_MSG		0x1
+#define KD6_SCOPE_IA_PD		0x2
+#define KD6_SCOPE_IAPREFIX	0x4
+
+/* Received messages */
+int kd6_parse_received(const u8 *opts, int len, struct kd6_reply *r);
+int kd6_take_server(struct dhcpv6_server_id *sid, const struct kd6_reply *r);
+
+/* Messages we send */
+int kd6_msg_len(u8 msg_type, bool rapid_commit,
+		const struct dhcpv6_server_id *server_id);
+int kd6_options_send_if(u8 msg_type,struct dhcpv6_packet dhp, const u8 *hw,
+		const struct dhcpv6_server_id *server_id,
+		const struct dhcpv6_ia_prefix *ia_prefix, const u8 *xid,
+		bool rapid_commit);
+
+/*
+ * Relay agent messages, section 9 of RFC 8415. A Relay-Forward carries
+ * the ifindex of the port the message came from as its Interface-ID.
+ */
+struct dhcpv6_relay_hdr {
+	u8 msg_type;
+	u8 hop_count;
+	u8 link_addr[16];
+	u8 peer_addr[16];
+}__attribute__((packed));
+
+/* What kd6_relay_repl_parse() finds in a Relay-Reply */
+struct kd6_relay {
+	struct in6_addr peer;		/* Where the message goes */
+	u32 ifindex;			/* Out of which port, 0 when unknown */
+	const u8 *msg;			/* Relay Message, inside the buffer */
+	u16 msg_len;
+};
+
+int kd6_relay_forw_len(int len);
+int kd6_relay_forw_build(u8 *buf, const u8 *msg, int len,
+		const struct in6_addr *link, const struct in6_addr *peer,
+		u32 ifindex);
+int kd6_relay_repl_parse(const u8 *buf, int len, struct kd6_relay *rr);
+
+/*
+ * Answer of the delegating server to a requesting router, built by
+ * kd6_pds_build() after the client and server identifiers.
+ */
+struct kd6_pds_answer {
+	u8 msg_type;			/* ADVERTISE or REPLY */
+	bool rapid_commit;
+	bool msg_status;		/* Message level Success, for RELEASE */
+	bool have_ia_pd;		/* Answer about the IA_PD */
+	u16 ia_status;			/* Success: the prefix below */
+	u32 t1, t2, preferred, valid;
+	u8 plen;
+	struct in6_addr prefix;
+	const u8 *dns;			/* DNS options, copied as they are */
+	u16 dns_len;
+};
+#define KD6_PDS_MSG_MAX 768 /* Longest answer, DUIDs and DNS included */
+
+int kd6_pds_build(u8 *buf, const u8 *xid, const struct kd6_reply *req,
+		const u8 *duid, int duid_len, const struct kd6_pds_answer *a);
+
+/* RDNSS and DNSSL of our RAs, from the DNS options of the lease */
+int kd6_dns_ra_build(u8 *buf, const u8 *dns, int len, u32 lifetime);
+
+/* DUID-LLT time of our client identifier */
+extern __be32 kd6_duid_time;
+int GetMon (const char *str);
+u32 convertTimeDateToSeconds(const struct tm date);
+void kd6_duid_set_time(const char *version);
+int kd6_duid_fill(u8 *duid, const u8 *hw);
+
+/* Subprefixes of a delegation */
+#define KD6_MAX_SLOTS_SHIFT 16 /* Up to 65536 /64s of a delegation */
+u64 kd6_prefix_base(const u8 *prefix_addr, u8 plen);
+u8 kd6_port_len(const char *port_size, const char *name);
+unsigned int kd6_slot_pref(const char *name, unsigned int nslots,
+		unsigned int n);
+void kd6_subprefix(u64 base, unsigned int slot, struct in6_addr *prefix);
+
+#endif /* _KD6_PROTO_H */
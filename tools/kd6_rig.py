@@ -0,0 +1,355 @@
+#!/usr/bin/env python3
+"""
+kd6_rig.py - end-to-end time-to-prefix rig for the DANIR module.
+
+Builds three network namespaces joined by veth pairs:
+
+    kd6-srv [srv0] ---- [up0] kd6-rtr [dn0] ---- [cli0] kd6-cli
+    stand-in server       router, runs danir.ko      host behind it
+
+runs a small DHCPv6-PD responder in kd6-srv, loads the module with the
+initial namespace disabled, enables it in kd6-rtr only, and measures from
+just before insmod:
+
+    reply     the responder sent the REPLY that bound the prefix
+    addr      the /64 was configured on the downstream port dn0
+    ra        the first RA with a prefix reached kd6-cli
+    slaac     kd6-cli configured an address from it
+
+and whether the first SOLICIT was answered. up0 is left down for the
+module to bring up, so that message goes out right after link up, while
+DAD is still running on the link-local address; --no-dad turns DAD off
+in every namespace.
+
+netem loss and delay can be put on both ends of the uplink. Needs root,
+iproute2 with tc, and the module built in the parent directory:
+
+    sudo ./kd6_rig.py --runs 20 --loss 10 --delay 50
+"""
+
+import argparse
+import ipaddress
+import json
+import os
+import select
+import signal
+import socket
+import statistics
+import struct
+import subprocess
+import sys
+import time
+
+NS_SRV, NS_RTR, NS_CLI = "kd6-srv", "kd6-rtr", "kd6-cli"
+HERE = os.path.dirname(os.path.abspath(__file__))
+MODULE = os.path.join(HERE, "..", "danir.ko")
+
+# DHCPv6, RFC 3315 and RFC 3633
+SOLICIT, ADVERTISE, REQUEST, RENEW, REBIND, REPLY = 1, 2, 3, 5, 6, 7
+OPT_CLIENTID, OPT_SERVERID, OPT_STATUS_CODE = 1, 2, 13
+OPT_RAPID_COMMIT, OPT_IA_PD, OPT_IAPREFIX = 14, 25, 26
+MSG_NAMES = {SOLICIT: "SOLICIT", ADVERTISE: "ADVERTISE", REQUEST: "REQUEST",
+             RENEW: "RENEW", REBIND: "REBIND", REPLY: "REPLY"}
+
+
+def sh(*cmd, ns=None, check=True):
+    if ns:
+        cmd = ("ip", "netns", "exec", ns) + cmd
+    return subprocess.run(cmd, check=check, stdout=subprocess.PIPE,
+                          stderr=subprocess.PIPE, text=True).stdout
+
+
+def ns_popen(ns, *args):
+    cmd = ("ip", "netns", "exec", ns, sys.executable, os.path.abspath(__file__)) + args
+    return subprocess.Popen(cmd, stdout=subprocess.PIPE, text=True, bufsize=1)
+
+
+# ---------------------------------------------------------------- responder
+
+def opt(code, data=b""):
+    return struct.pack("!HH", code, len(data)) + data
+
+
+def options(data):
+    off = 0
+    while off + 4 <= len(data):
+        code, length = struct.unpack_from("!HH", data, off)
+        yield code, data[off + 4:off + 4 + length]
+        off += 4 + length
+
+
+def responder(args):
+    """Answer every SOLICIT, REQUEST, RENEW and REBIND with the same prefix.
+
+    Logs one JSON line per message, with CLOCK_MONOTONIC timestamps that
+    every namespace shares.
+    """
+    net = ipaddress.IPv6Network(args.prefix)
+    # DUID-LLT of 14 bytes
+    server_id = opt(OPT_SERVERID, struct.pack("!HHI", 1, 1, 0x2b5e1a90) +
+                    bytes.fromhex("02d6000000fe"))
+    ifindex = socket.if_nametoindex(args.dev)
+    s = socket.socket(socket.AF_INET6, socket.SOCK_DGRAM)
+    s.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    s.bind(("::", 547))
+    mreq = socket.inet_pton(socket.AF_INET6, "ff02::1:2") + struct.pack("@I", ifindex)
+    s.setsockopt(socket.IPPROTO_IPV6, socket.IPV6_JOIN_GROUP, mreq)
+    print(json.dumps({"ready": time.monotonic()}), flush=True)
+
+    while True:
+        data, addr = s.recvfrom(2048)
+        now = time.monotonic()
+        if len(data) < 4 or data[0] not in (SOLICIT, REQUEST, RENEW, REBIND):
+            continue
+        msg_type, xid = data[0], data[1:4]
+        opts = dict(options(data[4:]))
+        print(json.dumps({"t": now, "rx": MSG_NAMES[msg_type],
+                          "xid": xid.hex(), "src": addr[0]}), flush=True)
+        # Sent from :: by a client whose link-local address is tentative
+        if ipaddress.IPv6Address(addr[0].split("%")[0]).is_unspecified:
+            continue
+        if OPT_CLIENTID not in opts or OPT_IA_PD not in opts:
+            continue
+        rapid = msg_type == SOLICIT and OPT_RAPID_COMMIT in opts and args.rapid_commit
+        reply = ADVERTISE if msg_type == SOLICIT and not rapid else REPLY
+
+        iaprefix = opt(OPT_IAPREFIX, struct.pack("!IIB", args.preferred, args.valid,
+                                                 net.prefixlen) + net.network_address.packed)
+        ia_pd = opt(OPT_IA_PD, opts[OPT_IA_PD][:4] +
+                    struct.pack("!II", args.preferred // 2, args.preferred * 4 // 5) +
+                    iaprefix)
+        out = bytes([reply]) + xid + opt(OPT_CLIENTID, opts[OPT_CLIENTID]) + server_id
+        if rapid:
+            out += opt(OPT_RAPID_COMMIT)
+        out += ia_pd
+        s.sendto(out, (addr[0], 546, 0, ifindex))
+        print(json.dumps({"t": time.monotonic(), "tx": MSG_NAMES[reply],
+                          "xid": xid.hex()}), flush=True)
+
+
+# ------------------------------------------------------------------ watcher
+
+def watch(args):
+    """Report the first RA carrying a prefix, then the SLAAC address."""
+    s = socket.socket(socket.AF_INET6, socket.SOCK_RAW, socket.IPPROTO_ICMPV6)
+    s.setsockopt(socket.SOL_SOCKET, socket.SO_BINDTODEVICE, args.dev.encode())
+    print(json.dumps({"ready": time.monotonic()}), flush=True)
+    seen_ra = False
+    while True:
+        r, _, _ = select.select([s], [], [], 0.01)
+        if r and not seen_ra:
+            data = s.recv(2048)
+            # Router Advertisement with a Prefix Information option
+            if data[0] == 134 and any(code == 3 for code in ra_options(data[16:])):
+                print(json.dumps({"t": time.monotonic(), "ra": True}), flush=True)
+                seen_ra = True
+        elif r:
+            s.recv(2048)
+        if seen_ra and global_addr(args.dev):
+            print(json.dumps({"t": time.monotonic(), "slaac": True}), flush=True)
+            return
+
+
+def ra_options(data):
+    off = 0
+    while off + 2 <= len(data) and data[off + 1]:
+        yield data[off]
+        off += data[off + 1] * 8
+
+
+def global_addr(dev, ns=None):
+    out = sh("ip", "-6", "-o", "addr", "show", "dev", dev, "scope", "global",
+             ns=ns, check=False)
+    return "inet6" in out and "tentative" not in out
+
+
+def ll_addr(dev, ns=None):
+    out = sh("ip", "-6", "-o", "addr", "show", "dev", dev, "scope", "link",
+             ns=ns, check=False)
+    return "inet6" in out and "tentative" not in out
+
+
+# --------------------------------------------------------------------- rig
+
+def setup(args):
+    teardown()
+    for ns in (NS_SRV, NS_RTR, NS_CLI):
+        sh("ip", "netns", "add", ns)
+        if args.no_dad:
+            sh("sysctl", "-qw", "net.ipv6.conf.default.accept_dad=0", ns=ns)
+            sh("sysctl", "-qw", "net.ipv6.conf.all.accept_dad=0", ns=ns)
+        sh("ip", "link", "set", "lo", "up", ns=ns)
+    sh("sysctl", "-qw", "net.ipv6.conf.all.forwarding=1", ns=NS_RTR)
+    sh("ip", "link", "add", "srv0", "netns", NS_SRV, "type", "veth",
+       "peer", "name", "up0", "netns", NS_RTR)
+    sh("ip", "link", "add", "dn0", "netns", NS_RTR, "type", "veth",
+       "peer", "name", "cli0", "netns", NS_CLI)
+    sh("sysctl", "-qw", "net.ipv6.conf.cli0.accept_ra=2", ns=NS_CLI)
+    # up0 is brought up by the module
+    for ns, dev in ((NS_SRV, "srv0"), (NS_RTR, "dn0"), (NS_CLI, "cli0")):
+        sh("ip", "link", "set", dev, "up", ns=ns)
+    if args.loss or args.delay:
+        netem = ["netem"]
+        if args.delay:
+            netem += ["delay", "%dms" % args.delay]
+            if args.jitter:
+                netem += ["%dms" % args.jitter]
+        if args.loss:
+            netem += ["loss", "%g%%" % args.loss]
+        for ns, dev in ((NS_SRV, "srv0"), (NS_RTR, "up0")):
+            sh("tc", "qdisc", "add", "dev", dev, "root", *netem, ns=ns)
+    # The responder answers from its link-local address
+    deadline = time.monotonic() + 5
+    while not ll_addr("srv0", ns=NS_SRV):
+        if time.monotonic() > deadline:
+            raise RuntimeError("no link-local address on srv0")
+        time.sleep(0.05)
+
+
+def teardown():
+    sh("rmmod", "danir", check=False)
+    for ns in (NS_SRV, NS_RTR, NS_CLI):
+        sh("ip", "netns", "del", ns, check=False)
+
+
+def wait_line(proc, key, deadline):
+    """Next JSON line of proc holding key, or None at the deadline."""
+    while True:
+        left = deadline - time.monotonic()
+        if left <= 0:
+            return None
+        r, _, _ = select.select([proc.stdout], [], [], left)
+        if not r:
+            return None
+        line = proc.stdout.readline()
+        if not line:
+            return None
+        ev = json.loads(line)
+        if key in ev:
+            return ev
+
+
+def one_run(args):
+    setup(args)
+    srv = ns_popen(NS_SRV, "responder", "--dev", "srv0", "--prefix", args.prefix,
+                   *(["--rapid-commit"] if args.rapid_commit else []))
+    cli = ns_popen(NS_CLI, "watch", "--dev", "cli0")
+    procs = (srv, cli)
+    res = {}
+    try:
+        deadline = time.monotonic() + 5
+        if not wait_line(srv, "ready", deadline) or not wait_line(cli, "ready", deadline):
+            raise RuntimeError("responder or watcher did not start")
+
+        params = ["init_enable=0"] + args.param
+        if args.rapid_commit:
+            params.append("rapid_commit=1")
+        t0 = time.monotonic()
+        sh("insmod", args.module, *params)
+        sh("sysctl", "-qw", "net.danir.enable=1", ns=NS_RTR)
+        deadline = t0 + args.timeout
+
+        # The responder logs every message; the first REPLY binds
+        sent = {}
+        first = None
+        while True:
+            ev = wait_line(srv, "t", deadline)
+            if not ev:
+                break
+            if "rx" in ev:
+                sent[ev["rx"]] = sent.get(ev["rx"], 0) + 1
+                if ev["rx"] == "SOLICIT" and sent["SOLICIT"] == 1:
+                    first = ev["xid"]
+                    res["first"] = False
+            elif ev.get("xid") == first and sent.get("SOLICIT") == 1:
+                res["first"] = True
+            if ev.get("tx") == "REPLY":
+                res["reply"] = ev["t"] - t0
+                break
+        res["msgs"] = sent
+
+        while "reply" in res and time.monotonic() < deadline:
+            if global_addr("dn0", ns=NS_RTR):
+                res["addr"] = time.monotonic() - t0
+                break
+            time.sleep(0.005)
+        ev = wait_line(cli, "ra", deadline)
+        if ev:
+            res["ra"] = ev["t"] - t0
+            ev = wait_line(cli, "slaac", deadline)
+            if ev:
+                res["slaac"] = ev["t"] - t0
+    finally:
+        for p in procs:
+            p.send_signal(signal.SIGTERM)
+            p.wait()
+        teardown()
+    return res
+
+
+def summary(name, values, runs):
+    if not values:
+        print("%-6s   no result in %d runs" % (name, runs))
+        return
+    values = sorted(values)
+    p90 = values[min(len(values) - 1, int(len(values) * 0.9))]
+    print("%-6s %3d/%d  min %8.1f  median %8.1f  p90 %8.1f  max %8.1f ms" %
+          (name, len(values), runs, values[0] * 1e3, statistics.median(values) * 1e3,
+           p90 * 1e3, values[-1] * 1e3))
+
+
+def run(args):
+    if os.geteuid():
+        sys.exit("kd6_rig: needs root")
+    results = []
+    for i in range(args.runs):
+        res = one_run(args)
+        results.append(res)
+        print("run %d: %s" % (i + 1, json.dumps(res)), flush=True)
+    print()
+    for key in ("reply", "addr", "ra", "slaac"):
+        summary(key, [r[key] for r in results if key in r], args.runs)
+    solicits = [r["msgs"].get("SOLICIT", 0) for r in results]
+    print("SOLICITs per run: mean %.2f, max %d" % (statistics.mean(solicits), max(solicits)))
+    answered = sum(1 for r in results if r.get("first"))
+    print("First SOLICIT answered: %d/%d" % (answered, args.runs))
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__,
+                                 formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = ap.add_subparsers(dest="cmd")
+
+    r = sub.add_parser("run", help="measure time to prefix (default)")
+    r.add_argument("--runs", type=int, default=10)
+    r.add_argument("--loss", type=float, default=0, help="netem loss on the uplink, %%")
+    r.add_argument("--delay", type=int, default=0, help="netem delay on the uplink, ms")
+    r.add_argument("--jitter", type=int, default=0, help="netem delay jitter, ms")
+    r.add_argument("--timeout", type=float, default=60, help="per run, seconds")
+    r.add_argument("--prefix", default="2001:db8:100::/56")
+    r.add_argument("--rapid-commit", action="store_true")
+    r.add_argument("--no-dad", action="store_true",
+                   help="disable DAD, link-local addresses are usable at once")
+    r.add_argument("--module", default=MODULE)
+    r.add_argument("--param", action="append", default=[],
+                   help="extra module parameter, e.g. port_size=dn0=60")
+
+    p = sub.add_parser("responder", help=argparse.SUPPRESS)
+    p.add_argument("--dev", required=True)
+    p.add_argument("--prefix", required=True)
+    p.add_argument("--rapid-commit", action="store_true")
+    p.add_argument("--preferred", type=int, default=3600)
+    p.add_argument("--valid", type=int, default=7200)
+
+    w = sub.add_parser("watch", help=argparse.SUPPRESS)
+    w.add_argument("--dev", required=True)
+
+    argv = sys.argv[1:]
+    if not argv or argv[0].startswith("-"):
+        argv = ["run"] + argv
+    args = ap.parse_args(argv)
+    {"run": run, "responder": responder, "watch": watch}[args.cmd](args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,266 @@
+/**
+ * @file    kd6_bench.c
+ * @brief Throughput of the protocol core of the DANIR client, in
+ * 	  userspace: parsing of server replies, building of our messages,
+ * 	  subprefix and DUID arithmetic.
+ *
+ * 	  ./kd6_bench [-n iterations] [corpus files...]
+ *
+ * 	  A corpus file holds one DHCPv6 message, from its type to its last
+ * 	  option, in hex; blanks and '#' comments are ignored. A capture can
+ * 	  be turned into one with e.g.
+ * 	  tshark -r pd.pcap -Y dhcpv6 -T fields -e udp.payload
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <glob.h>
+
+#include "kd6_proto.h"
+
+#define KD6_BENCH_MSG_MAX 1500
+#define KD6_BENCH_ITERATIONS 1000000
+
+struct kd6_bench_msg {
+	const char *name;
+	u8 buf[KD6_BENCH_MSG_MAX];
+	int len;
+};
+
+/* Keeps the compiler from dropping the work */
+static volatile unsigned long kd6_sink;
+
+static double kd6_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void kd6_report(const char *what, unsigned long n, double ns)
+{
+	printf("%-10s %10lu msgs %12.0f msgs/s %8.1f ns/msg\n",
+			what, n, n / ns * 1e9, ns / n);
+}
+
+static int kd6_load(const char *path, struct kd6_bench_msg *m)
+{
+	FILE *f = fopen(path, "r");
+	int c, hi = -1, v;
+
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	m->name = path;
+	m->len = 0;
+	while ((c = fgetc(f)) != EOF) {
+		if (c == '#') {
+			while ((c = fgetc(f)) != EOF && c != '\n')
+				;
+			continue;
+		}
+		if (c >= '0' && c <= '9')
+			v = c - '0';
+		else if (c >= 'a' && c <= 'f')
+			v = c - 'a' + 10;
+		else if (c >= 'A' && c <= 'F')
+			v = c - 'A' + 10;
+		else
+			continue;
+		if (hi < 0) {
+			hi = v;
+			continue;
+		}
+		if (m->len == KD6_BENCH_MSG_MAX)
+			break;
+		m->buf[m->len++] = hi << 4 | v;
+		hi = -1;
+	}
+	fclose(f);
+	if (m->len < 4 || hi >= 0) {
+		fprintf(stderr, "%s: not a DHCPv6 message\n", path);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ *  What each message parses into, so that a corpus can be checked by eye.
+ */
+static void kd6_show(const struct kd6_bench_msg *m)
+{
+	struct kd6_reply r;
+	char addr[INET6_ADDRSTRLEN];
+	int err;
+
+	err = kd6_parse_received(m->buf + 4, m->len - 4, &r);
+	printf("%s: type %u, %d bytes", m->name, m->buf[0], m->len);
+	if (err) {
+		printf(", malformed (%d)\n", err);
+		return;
+	}
+	printf(", status %u/%u, server id %u bytes%s", r.status, r.ia_status,
+			r.server_id_len, r.rapid_commit ? ", rapid commit" : "");
+	if (r.dns_len)
+		printf(", dns %u bytes, %d in RAs", r.dns_len,
+				kd6_dns_ra_build(NULL, r.dns, r.dns_len, 0));
+	if (r.have_prefix) {
+		inet_ntop(AF_INET6, r.ia_prefix.prefix_addr, addr, sizeof(addr));
+		printf(", prefix %s/%u valid %u", addr, r.ia_prefix.prefix_len,
+				ntohl(r.ia_prefix.valid_lifetime));
+	}
+	printf("\n");
+}
+
+static void kd6_bench_parse(const struct kd6_bench_msg *msgs, int nmsgs,
+		unsigned long iterations)
+{
+	struct kd6_reply r;
+	unsigned long i;
+	double t;
+
+	t = kd6_now_ns();
+	for (i = 0; i < iterations; i++) {
+		const struct kd6_bench_msg *m = &msgs[i % nmsgs];
+
+		kd6_parse_received(m->buf + 4, m->len - 4, &r);
+		kd6_sink += r.have_prefix;
+	}
+	kd6_report("parse", iterations, kd6_now_ns() - t);
+}
+
+/*
+ *  The messages of a client going through SOLICIT, REQUEST, RENEW and
+ *  REBIND, into a zeroed buffer like the module's fresh skbs.
+ */
+static void kd6_bench_build(unsigned long iterations)
+{
+	static const u8 types[] = { KD6_SOLICIT, KD6_REQUEST, KD6_RENEW,
+		KD6_REBIND };
+	static const u8 hw[ETH_ALEN] = { 0x52, 0x54, 0x00, 0x12, 0x34, 0x56 };
+	struct dhcpv6_server_id sid;
+	struct dhcpv6_ia_prefix pfx;
+	struct dhcpv6_packet dhp;
+	u8 buf[KD6_BENCH_MSG_MAX];
+	u8 xid[3] = { 0x5a, 0x3c, 0x11 };
+	unsigned long i;
+	double t;
+	u8 type;
+
+	memset(&sid, 0x11, sizeof(sid));
+	sid.option_len = htons(14);	/* DUID-LLT */
+	memset(&pfx, 0x22, sizeof(pfx));
+	dhp.kd6_sol = (void *)buf;
+	dhp.kd6_req = (void *)buf;
+	dhp.kd6_reb = (void *)buf;
+
+	t = kd6_now_ns();
+	for (i = 0; i < iterations; i++) {
+		type = types[i % ARRAY_SIZE(types)];
+		memset(buf, 0, kd6_msg_len(type, false, &sid));
+		xid[2] = i;
+		kd6_sink += kd6_options_send_if(type, dhp, hw, &sid, &pfx, xid,
+				false);
+	}
+	kd6_report("build", iterations, kd6_now_ns() - t);
+}
+
+/*
+ *  Preferred subprefix of a port out of a /48, as on every renumbering.
+ */
+static void kd6_bench_subprefix(unsigned long iterations)
+{
+	static const u8 delegated[16] = { 0x20, 0x01, 0x0d, 0xb8, 0xab, 0xcd };
+	char name[16];
+	struct in6_addr prefix;
+	unsigned long i;
+	unsigned int nslots = 1U << KD6_MAX_SLOTS_SHIFT;
+	u64 base;
+	double t;
+	u8 len;
+
+	t = kd6_now_ns();
+	for (i = 0; i < iterations; i++) {
+		snprintf(name, sizeof(name), "eth%lu", i & 1023);
+		base = kd6_prefix_base(delegated, 48);
+		len = kd6_port_len("eth1=60,eth2=60", name);
+		kd6_subprefix(base, kd6_slot_pref(name, nslots,
+					1U << (64 - len)), &prefix);
+		kd6_sink += prefix.s6_addr[7];
+	}
+	kd6_report("subprefix", iterations, kd6_now_ns() - t);
+}
+
+static void kd6_bench_duid(unsigned long iterations)
+{
+	static const char version[] =
+		"#7 SMP PREEMPT Fri Aug 23 04:58:09 CEST 2019";
+	unsigned long i;
+	double t;
+
+	t = kd6_now_ns();
+	for (i = 0; i < iterations; i++) {
+		kd6_duid_set_time(version);
+		kd6_sink += kd6_duid_time;
+	}
+	kd6_report("duid", iterations, kd6_now_ns() - t);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long iterations = KD6_BENCH_ITERATIONS;
+	struct kd6_bench_msg *msgs;
+	glob_t g = { 0 };
+	char **files;
+	int nfiles, nmsgs = 0;
+	int i, opt;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		switch (opt) {
+			case 'n':
+				iterations = strtoul(optarg, NULL, 0);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-n iterations] [corpus files...]\n",
+						argv[0]);
+				return 1;
+		}
+	}
+	if (!iterations)
+		iterations = 1;
+
+	files = argv + optind;
+	nfiles = argc - optind;
+	if (!nfiles) {
+		glob("corpus/*.hex", 0, NULL, &g);
+		files = g.gl_pathv;
+		nfiles = g.gl_pathc;
+	}
+	if (!nfiles) {
+		fprintf(stderr, "No corpus, run from user/ or name the files\n");
+		return 1;
+	}
+
+	msgs = calloc(nfiles, sizeof(*msgs));
+	if (!msgs)
+		return 1;
+	for (i = 0; i < nfiles; i++)
+		if (!kd6_load(files[i], &msgs[nmsgs])) {
+			kd6_show(&msgs[nmsgs]);
+			nmsgs++;
+		}
+	if (!nmsgs)
+		return 1;
+	printf("\n");
+
+	kd6_bench_parse(msgs, nmsgs, iterations);
+	kd6_bench_build(iterations);
+	kd6_bench_subprefix(iterations);
+	kd6_bench_duid(iterations);
+
+	free(msgs);
+	globfree(&g);
+	return 0;
+}
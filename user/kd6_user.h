@@ -0,0 +1,119 @@
+/**
+ * @file    kd6_user.h
+ * @brief The few kernel definitions kd6_proto.c needs, for building it
+ * 	  as a userspace library.
+ */
+
+#ifndef _KD6_USER_H
+#define _KD6_USER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <endian.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef uint16_t __be16;
+typedef uint32_t __be32;
+typedef uint64_t __be64;
+
+#define ETH_ALEN	6
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+#define pr_debug(...)	do { } while (0)
+
+#define cpu_to_be64(x)	htobe64(x)
+#define be64_to_cpu(x)	be64toh(x)
+
+static inline u16 get_unaligned_be16(const void *p)
+{
+	const u8 *b = p;
+
+	return b[0] << 8 | b[1];
+}
+
+static inline u32 get_unaligned_be32(const void *p)
+{
+	const u8 *b = p;
+
+	return (u32)b[0] << 24 | b[1] << 16 | b[2] << 8 | b[3];
+}
+
+/*
+ * jhash() of linux/jhash.h (Bob Jenkins' lookup3), so that a port gets
+ * the same preferred subprefix here as in the module.
+ */
+#define JHASH_INITVAL	0xdeadbeef
+
+static inline u32 rol32(u32 word, unsigned int shift)
+{
+	return (word << shift) | (word >> ((-shift) & 31));
+}
+
+#define __jhash_mix(a, b, c)			\
+{						\
+	a -= c;  a ^= rol32(c, 4);  c += b;	\
+	b -= a;  b ^= rol32(a, 6);  a += c;	\
+	c -= b;  c ^= rol32(b, 8);  b += a;	\
+	a -= c;  a ^= rol32(c, 16); c += b;	\
+	b -= a;  b ^= rol32(a, 19); a += c;	\
+	c -= b;  c ^= rol32(b, 4);  b += a;	\
+}
+
+#define __jhash_final(a, b, c)			\
+{						\
+	c ^= b; c -= rol32(b, 14);		\
+	a ^= c; a -= rol32(c, 11);		\
+	b ^= a; b -= rol32(a, 25);		\
+	c ^= b; c -= rol32(b, 16);		\
+	a ^= c; a -= rol32(c, 4);		\
+	b ^= a; b -= rol32(a, 14);		\
+	c ^= b; c -= rol32(b, 24);		\
+}
+
+static inline u32 jhash(const void *key, u32 length, u32 initval)
+{
+	const u8 *k = key;
+	u32 a, b, c;
+
+	a = b = c = JHASH_INITVAL + length + initval;
+
+	while (length > 12) {
+		a += k[0] | (u32)k[1] << 8 | (u32)k[2] << 16 | (u32)k[3] << 24;
+		b += k[4] | (u32)k[5] << 8 | (u32)k[6] << 16 | (u32)k[7] << 24;
+		c += k[8] | (u32)k[9] << 8 | (u32)k[10] << 16 | (u32)k[11] << 24;
+		__jhash_mix(a, b, c);
+		length -= 12;
+		k += 12;
+	}
+	switch (length) {
+	case 12: c += (u32)k[11] << 24;	/* fall through */
+	case 11: c += (u32)k[10] << 16;	/* fall through */
+	case 10: c += (u32)k[9] << 8;	/* fall through */
+	case 9:  c += k[8];		/* fall through */
+	case 8:  b += (u32)k[7] << 24;	/* fall through */
+	case 7:  b += (u32)k[6] << 16;	/* fall through */
+	case 6:  b += (u32)k[5] << 8;	/* fall through */
+	case 5:  b += k[4];		/* fall through */
+	case 4:  a += (u32)k[3] << 24;	/* fall through */
+	case 3:  a += (u32)k[2] << 16;	/* fall through */
+	case 2:  a += (u32)k[1] << 8;	/* fall through */
+	case 1:  a += k[0];
+		 __jhash_final(a, b, c);
+		 break;
+	case 0:
+		 break;
+	}
+	return c;
+}
+
+#endif /* _KD6_USER_H */